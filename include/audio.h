@@ -0,0 +1,44 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "machine.h"
+#include "mixer.h"
+
+// the sound board: the samples in sounds/ and the port bits that trigger
+// them. needs no SDL, so the game (sounds.c) and the headless runner load
+// and play exactly the same samples.
+
+// the sample files, by sound number. the bank files made from them are
+// named in the games table (games.h).
+extern const char *wav_files[NUM_SOUNDS];
+
+// create a mixer with the samples for game (enum games) loaded, or with
+// synth set, one that only synthesizes the sounds and reads no files. the
+// game's bank file is mapped if there is one, then the Space Invaders bank,
+// and only without either are the wav files decoded. a missing or
+// unreadable file leaves its sound silent. returns NULL if the mixer can't
+// be created.
+Mixer *audio_create(int game, int synth);
+
+// read a PCM wav file (8 or 16 bits, any channels and rate) as 16-bit mono
+// samples at MIX_RATE. returns the samples (free them) and sets *length,
+// or returns NULL if the file can't be read.
+int16_t *audio_load_wav(const char *path, int *length);
+
+// start and stop the samples for the sound port bits that changed, or pass
+// the ports to the synthesizer if machine->sound.synth is set, at the
+// emulated time of the port write. called on every OUT while the machine
+// has a mixer.
+void play_sounds(SpaceInvadersMachine *machine);
+
+// write a 16-bit mono MIX_RATE wav file a block at a time. open writes a
+// header with the sizes left blank and close fills them in. open returns
+// NULL and the others -1 on failure.
+FILE *wav_open(const char *path);
+int wav_write(FILE *file, const int16_t *samples, int count);
+int wav_close(FILE *file);
+
+#endif /* AUDIO_H */
@@ -0,0 +1,56 @@
+#ifndef BANK_H
+#define BANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// sound bank: every sample of a game already in the mixer's format (16-bit
+// mono at MIX_RATE, host byte order) in one file, made ahead of time by
+// i8080-mkbank. the file is mapped into memory as it is and the mixer plays
+// straight from the mapping, so loading is one mmap and a few checks.
+//
+// layout: a BankHeader, its count BankEntry records, then the samples of
+// each sound, starting on a BANK_ALIGN byte boundary.
+
+#define BANK_MAGIC "i8080snd"
+#define BANK_VERSION 1
+#define BANK_ALIGN 64
+#define BANK_BYTE_ORDER 0x01020304 // reads differently on a host of the other byte order
+
+typedef struct BankEntry
+{
+    uint64_t offset; // of the samples from the start of the file
+    uint32_t length; // in samples, 0 for a sound that is missing
+    uint32_t reserved;
+} BankEntry;
+
+typedef struct BankHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t rate;
+    uint32_t count;
+    BankEntry entry[];
+} BankHeader;
+
+typedef struct SoundBank
+{
+    void *map; // NULL while no bank is open
+    size_t size;
+    const BankHeader *header;
+} SoundBank;
+
+// map a bank file. returns 0 on success and -1 (with a message) if it
+// can't be read or isn't a bank for this host and MIX_RATE.
+int bank_open(SoundBank *bank, const char *path);
+void bank_close(SoundBank *bank);
+
+// sound number sound of an open bank, or NULL if it has none. sets *length.
+const int16_t *bank_sound(const SoundBank *bank, int sound, int *length);
+
+// write count sounds (length[i] samples each, NULL for a missing one) as a
+// bank file. returns 0 on success and -1 on failure.
+int bank_write(const char *path, int16_t *const *samples, const int *length, int count);
+
+#endif /* BANK_H */
@@ -0,0 +1,57 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include "machine.h"
+
+// experimental lockstep engine for running many copies of the same ROM.
+// registers are kept in structure-of-arrays form so that lanes sitting at the
+// same PC can execute the instruction together with SIMD. lanes that diverge,
+// and instructions without a vector version, fall back to step_cpu().
+
+// lanes per batch - 16 8-bit registers fill one SSE register, 16 PCs one AVX2 register
+#define BATCH_LANES 16
+
+typedef struct Batch
+{
+    int count;      // lanes in use
+    int shared_rom; // all machines have the same program ROM, so code can be fetched from lane 0
+    SpaceInvadersMachine *machine[BATCH_LANES];
+    uint8_t *mem[BATCH_LANES];
+
+    // CPU state of every lane
+    uint8_t a[BATCH_LANES];
+    uint8_t b[BATCH_LANES];
+    uint8_t c[BATCH_LANES];
+    uint8_t d[BATCH_LANES];
+    uint8_t e[BATCH_LANES];
+    uint8_t h[BATCH_LANES];
+    uint8_t l[BATCH_LANES];
+    uint16_t sp[BATCH_LANES];
+    uint16_t pc[BATCH_LANES];
+    uint8_t z[BATCH_LANES];
+    uint8_t s[BATCH_LANES];
+    uint8_t p[BATCH_LANES];
+    uint8_t cy[BATCH_LANES];
+    uint8_t ac[BATCH_LANES];
+    uint8_t int_enable[BATCH_LANES];
+    int32_t cycles[BATCH_LANES];
+    uint8_t in_soa[BATCH_LANES]; // registers are current here rather than in the machine
+
+    // instruction counts, for judging how well the lanes stay together
+    uint64_t vector_steps; // instructions executed for a whole group at once
+    uint64_t vector_lanes; // lane-instructions covered by those
+    uint64_t scalar_steps; // lane-instructions run through step_cpu
+} Batch;
+
+// group up to BATCH_LANES machines. the machines stay owned by the caller.
+// returns NULL if count is out of range or allocation fails.
+Batch *batch_create(SpaceInvadersMachine **machines, int count);
+
+// run one frame (see run_frame) on every lane. inputs are set on the
+// machines as usual before the call.
+void batch_run_frame(Batch *batch);
+
+void batch_destroy(Batch *batch);
+
+#endif /* BATCH_H */
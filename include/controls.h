@@ -2,31 +2,7 @@
 #define CONTROLS_H
 
 #include <stdint.h>
-#include "processor.h"
-
-// create a machine object - see http://www.emulator101.com/cocoa-port-pt-2---machine-object.html
-typedef struct SpaceInvadersMachine
-{
-    State8080 *state;
-
-    double lastTimer;
-    double nextInterrupt;
-    int whichInterrupt;
-
-    uint8_t in_port;
-    uint8_t in_port_2;
-    uint8_t out_port;
-
-    uint8_t shift0;       // LSB of external shift hardware
-    uint8_t shift1;       // MSB of external shift hardware
-    uint8_t shift_offset; // offset for external shift hardware
-
-    uint8_t out_port_3;
-    uint8_t out_port_5;
-    uint8_t prev_out_port_3;
-    uint8_t prev_out_port_5;
-
-} SpaceInvadersMachine;
+#include "machine.h"
 
 enum port_keys
 {
@@ -41,10 +17,17 @@ enum port_keys
     KEY_P2_SHOOT,
     KEY_P2_LEFT,
     KEY_P2_RIGHT,
-    KEY_COIN_INFO
+    KEY_COIN_INFO,
+    NUM_KEYS
 };
 
 void key_down(SpaceInvadersMachine *machine, uint8_t key);
 void key_up(SpaceInvadersMachine *machine, uint8_t key);
 
+// bring in_port and in_port_2 up to date with machine->keys, the keys held
+// down (one bit per port_keys value) as another thread last wrote them.
+// the input port handlers call it on every read of a player's inputs, so
+// the game sees a key as soon as it next looks, not at the next frame.
+void keys_sample(SpaceInvadersMachine *machine);
+
 #endif /* CONTROLS_H */
\ No newline at end of file
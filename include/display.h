@@ -5,7 +5,19 @@
 #include <SDL2/SDL.h>
 
 void *get_framebuffer(State8080 *state);
-void wipe_surface(SDL_Surface *surface);
-void set_pixel(SDL_Surface *surface, int x, int y, uint8_t r, uint8_t g, uint8_t b);
+uint8_t *get_dirty_columns(State8080 *state);
 
-#endif /* DISPLAY_H */
\ No newline at end of file
+// the screen is a 224x256 streaming texture scaled to the window by SDL, so
+// the window can be any size. the game (enum games) picks the colour
+// overlay. init returns 0 on success and -1 on failure.
+int init_display(SDL_Window *window, int game);
+void close_display(void);
+
+// draw the columns of the rotated 1bpp video memory flagged in columns,
+// clear their flags and present the frame if any changed.
+void draw_screen(const uint8_t *vram, uint8_t *columns);
+
+// present the current frame again without drawing anything
+void present_screen(void);
+
+#endif /* DISPLAY_H */
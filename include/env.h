@@ -0,0 +1,63 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// step API for driving the emulator from an agent instead of the SDL loop:
+//   env_reset(env, game)
+//   env_step(env, action, frames, &result) -> observation, reward, done
+// the env never touches SDL, so it can be built with -DHEADLESS (make env).
+
+// raw video RAM is 224 columns of 32 bytes, 1 bit per pixel
+#define ENV_VRAM_SIZE (224 * 32)
+
+// grayscale observation is the rotated screen downsampled 2x2 (224x256 -> 112x128)
+#define ENV_GRAY_WIDTH 112
+#define ENV_GRAY_HEIGHT 128
+#define ENV_GRAY_SIZE (ENV_GRAY_WIDTH * ENV_GRAY_HEIGHT)
+
+enum env_observations
+{
+    ENV_OBS_VRAM, // ENV_VRAM_SIZE bytes, the game's own video memory
+    ENV_OBS_GRAY  // ENV_GRAY_SIZE bytes, one byte (0-255) per pixel, top row first
+};
+
+// actions are a bit mask of player 1 controls
+enum env_actions
+{
+    ENV_NOOP = 0x0,
+    ENV_LEFT = 0x1,
+    ENV_RIGHT = 0x2,
+    ENV_FIRE = 0x4
+};
+
+typedef struct EnvStep
+{
+    const uint8_t *observation; // valid until the next env call
+    int reward;                 // points scored during the step
+    int done;                   // game over: the last life was lost, or the game ended
+    uint64_t hash;              // machine_hash() after the step, equal states have equal hashes
+} EnvStep;
+
+typedef struct Env Env;
+
+// create an env producing the given observation type. returns NULL on failure.
+Env *env_create(int obs_type);
+
+// load a game (see enum games in memory.h), insert a coin and start a
+// one player game. ROM files are only read the first time a game is used.
+// returns 0 on success, -1 if the game could not be loaded or started.
+int env_reset(Env *env, int game);
+
+// hold the action for the given number of frames (frame skip) and report the
+// observation after the last one. returns the number of frames actually run,
+// which is less than frames if the game ended, or -1 if no game is loaded.
+int env_step(Env *env, int action, int frames, EnvStep *result);
+
+// size in bytes of the observations returned by env_step
+size_t env_observation_size(const Env *env);
+
+void env_destroy(Env *env);
+
+#endif /* ENV_H */
@@ -0,0 +1,49 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "video.h"
+
+// one finished frame: the video memory as the beam saw it, and the screen
+// columns that changed since the frame the reader took last. the writer
+// sets cycles itself.
+typedef struct Frame
+{
+    uint8_t vram[VRAM_SIZE];
+    uint8_t columns[SCREEN_WIDTH];
+    uint64_t cycles; // emulated time it was published at (machine_cycles)
+} Frame;
+
+// lock-free triple buffer handing frames from the emulation thread to the
+// drawing thread. the writer always has a free slot and the reader always
+// gets the newest frame, so neither waits for the other. frames the reader
+// never took are skipped, but their changed columns carry over.
+typedef struct FrameBuffer
+{
+    Frame frame[3];
+    atomic_int middle; // slot between the two threads, FRAME_FRESH set until read
+    int back;          // slot the writer fills
+    int front;         // slot the reader has
+    uint8_t carry[SCREEN_WIDTH]; // columns published since the reader's last known frame
+} FrameBuffer;
+
+#define FRAME_FRESH 4
+
+void frames_init(FrameBuffer *frames);
+
+// writer: copy columns x .. x + width - 1 of the video memory and their
+// dirty flags (clearing them) into the frame being built. a frame can be
+// captured in parts, e.g. the top of the screen at RST 1 and the rest at
+// RST 2, but every column has to be captured before it is published.
+void frames_capture(FrameBuffer *frames, const uint8_t *vram, uint8_t *columns, int x, int width);
+
+// writer: hand the frame being built to the reader
+void frames_publish(FrameBuffer *frames);
+
+// reader: the newest frame published since the last call, or NULL. the frame
+// stays valid until the next call.
+Frame *frames_take(FrameBuffer *frames);
+
+#endif /* FRAMES_H */
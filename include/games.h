@@ -0,0 +1,72 @@
+#ifndef GAMES_H
+#define GAMES_H
+
+#include <stdint.h>
+
+#include "controls.h"
+#include "memory.h"
+
+// what each game's board does with its I/O ports, as data. the port maps
+// are arrays indexed by port number, so an IN or OUT is one table lookup
+// and one call (ports.c) whatever the game, and the keys and sounds are
+// looked up the same way (controls.c, audio.c).
+
+// what reading a port returns
+enum port_inputs
+{
+    IN_NONE,    // nothing wired: 0
+    IN_FIXED,   // a constant, GameInfo.fixed
+    IN_PLAYER1, // the in_port byte: coin, starts, player 1
+    IN_PLAYER2, // the in_port_2 byte: player 2, tilt, switches
+    IN_SHIFT,   // the shift register's result
+    NUM_PORT_INPUTS
+};
+
+// what writing a port does
+enum port_outputs
+{
+    OUT_NONE,
+    OUT_SHIFT_OFFSET, // how far the shift register's result is shifted
+    OUT_SHIFT_DATA,   // the next byte into the shift register
+    OUT_SOUND1,       // sound bits, kept in out_port_3
+    OUT_SOUND2,       // sound bits, kept in out_port_5
+    OUT_WATCHDOG,     // resets the watchdog, which isn't emulated
+    NUM_PORT_OUTPUTS
+};
+
+// where a key shows up: the bits mask of an IN_PLAYER1 or IN_PLAYER2 byte.
+// input is IN_NONE for a key the board doesn't have.
+typedef struct GameKey
+{
+    uint8_t input;
+    uint8_t mask;
+} GameKey;
+
+// a sample played when the bits mask of an OUT_SOUND1 or OUT_SOUND2 port
+// go on. a looping sample plays until they go off again.
+typedef struct GameSound
+{
+    uint8_t output;
+    uint8_t mask;
+    uint8_t sample;
+    uint8_t loop;
+} GameSound;
+
+#define MAX_GAME_SOUNDS 16
+
+typedef struct GameInfo
+{
+    const char *name;
+    const char *bank; // sound bank made by make bank
+    uint8_t in[256];  // enum port_inputs for each port
+    uint8_t out[256]; // enum port_outputs for each port
+    uint8_t fixed;    // what IN_FIXED ports read
+    GameKey key[NUM_KEYS];
+    int num_sounds;
+    GameSound sound[MAX_GAME_SOUNDS];
+} GameInfo;
+
+// indexed by enum games
+extern const GameInfo games[NUM_GAMES];
+
+#endif /* GAMES_H */
@@ -0,0 +1,18 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+
+// write 32-bit pixels (0xaarrggbb, alpha ignored, top row first, width
+// pixels per row) to an image file. both return 0 on success and -1 if the
+// file could not be written.
+
+// binary PPM (P6), 24-bit RGB
+int image_write_ppm(const char *path, const uint32_t *pixels, int width, int height);
+
+// 8-bit palette PNG, compressed with the encoder in image.c so no zlib or
+// libpng is needed. the image can have at most 256 colours, which the
+// overlaid screen always has.
+int image_write_png(const char *path, const uint32_t *pixels, int width, int height);
+
+#endif /* IMAGE_H */
@@ -1,10 +1,32 @@
 #ifndef INTERUPTS_H
 #define INTERUPTS_H
 
+#include <time.h>
+
 #include "controls.h"
 
+// the 8080 runs at 2 MHz and the screen refreshes at 60 Hz
+#define CPU_CLOCK 2000000
+#define FRAME_CYCLES (CPU_CLOCK / 60)
+#define HALF_FRAME_CYCLES (FRAME_CYCLES / 2)
+
+// length of a frame in nanoseconds, from the cycle count so that the host
+// clock and the emulated one agree exactly
+#define FRAME_NS ((long long)FRAME_CYCLES * 1000000000 / CPU_CLOCK)
+
+// wait_frame gives up on catching up once it is this many frames behind
+#define MAX_FRAME_LAG 4
+
+// the beam has drawn this many of the 224 lines (screen columns, as the
+// monitor is on its side) when RST 1 fires
+#define MID_SCREEN_LINE 96
+
 void generate_interrupt(State8080 *state, int interrupt_num);
-void run_cpu(SpaceInvadersMachine *machine);
+int step_cpu(SpaceInvadersMachine *machine);
+void run_frame(SpaceInvadersMachine *machine);
+int run_cpu(SpaceInvadersMachine *machine);
+int run_to_interrupt(SpaceInvadersMachine *machine);
+void wait_frame(struct timespec *deadline, long long frame_ns);
 double time_ms();
 double time_us();
 
@@ -0,0 +1,78 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+// input-to-photon latency: follow a key press from the event loop through
+// the game to the screen. each press is timed at four points:
+//  - the key event, on the thread that reads the keyboard
+//  - the game's first read of the port bit the key changed
+//  - the first interrupt at which video memory differs from where the game
+//    would have been without the press. a copy of the machine taken at the
+//    read, with the key put back, runs alongside the game to tell.
+//  - the present of the first frame captured after that
+// one press is followed at a time, the ones in between are only counted.
+
+enum latency_stages
+{
+    LATENCY_IDLE,
+    LATENCY_EVENT,   // key event seen, waiting for the game to read it
+    LATENCY_READ,    // read, waiting for the screen to change
+    LATENCY_VRAM,    // changed, waiting for the frame to be presented
+};
+
+// a press that changes nothing on screen within this many interrupts
+// (2 s) is given up
+#define LATENCY_MAX_INTERRUPTS 240
+
+// a press that stops waiting for its read or its present for this long is
+// given up, e.g. when the window is hidden
+#define LATENCY_TIMEOUT_NS 2000000000LL
+
+typedef struct Latency
+{
+    SpaceInvadersMachine *machine; // the one being played
+    SpaceInvadersMachine *shadow;  // the same without the key press
+
+    // the press being followed. the thread that moves state on writes the
+    // fields of its stage first.
+    atomic_int state;
+    uint8_t key;
+    int down;
+    long long event_ns, read_ns, vram_ns;
+    uint64_t read_cycles, vram_cycles;
+    int interrupts; // since the read
+
+    // finished presses, in ns: event to read, read to screen change,
+    // change to present, and event to present. kept by the drawing thread.
+    long long *span[4];
+    int count;
+    int capacity;
+    int busy;    // presses while another one was followed
+    int unseen;  // presses that changed nothing on screen
+    int lost;    // presses given up waiting for a read or a present
+} Latency;
+
+// set up to follow presses on machine, once its game is loaded and before
+// it runs. takes the machine's input hook (machine.h), so other machines
+// are left alone. returns 0 or -1 on failure.
+int latency_init(Latency *latency, SpaceInvadersMachine *machine);
+
+// keyboard thread: key (enum port_keys) is about to go down or up
+void latency_key(Latency *latency, uint8_t key, int down);
+
+// emulation thread: call after each interrupt
+void latency_interrupt(Latency *latency);
+
+// drawing thread: a frame captured at emulated time cycles was presented
+void latency_present(Latency *latency, uint64_t cycles);
+
+// print the p50, p95 and p99 of each span
+void latency_report(const Latency *latency);
+
+void latency_free(Latency *latency);
+
+#endif /* LATENCY_H */
@@ -0,0 +1,128 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "memory.h"
+#include "processor.h"
+
+// machines are allocated on a cache line boundary so the hot CPU/port fields
+// and the start of memory never share a line with another machine.
+#define CACHE_LINE 64
+
+// number of samples mapped to the sound port bits (see sounds.c)
+#define NUM_SOUNDS 9
+
+struct Mixer;
+struct PortTable;
+
+// per-machine sound state, set up by init_sounds(). mixer is NULL when
+// there is no sound.
+typedef struct SoundState
+{
+    struct Mixer *mixer;
+    uint32_t device; // SDL audio device the mixer plays on
+    int synth;       // the mixer synthesizes the sounds instead of playing samples
+} SoundState;
+
+// create a machine object - see http://www.emulator101.com/cocoa-port-pt-2---machine-object.html
+// the machine owns everything needed to run one game, so several of them can
+// exist at the same time.
+typedef struct SpaceInvadersMachine
+{
+    State8080 state;
+
+    double lastTimer; // wall clock time (us) the cpu has been run up to
+    int whichInterrupt;
+    int numInterrupts;
+    int frameCycles; // cycles into the current frame (run_frame and run_cpu)
+    uint64_t frameStart; // emulated cycles run before the current frame
+
+    uint8_t game; // enum games: which ports, keys and sounds the board has (games.h)
+    const struct PortTable *ports; // game's port handlers (ports.h), NULL until a game is loaded
+    uint8_t in_port;
+    uint8_t in_port_2;
+    uint8_t out_port;
+
+    uint8_t shift0;       // LSB of external shift hardware
+    uint8_t shift1;       // MSB of external shift hardware
+    uint8_t shift_offset; // offset for external shift hardware
+
+    uint8_t out_port_3;
+    uint8_t out_port_5;
+    uint8_t prev_out_port_3;
+    uint8_t prev_out_port_5;
+
+    unsigned int keys_applied; // the keys in in_port and in_port_2 (see keys below)
+
+    // everything above is plain data that a snapshot copies as it is
+
+    // the table of pages the machine was last moved to by a snapshot or a
+    // restore. a memory page matches its page in the table while it is not
+    // dirty.
+    PageTable *pages;
+    uint8_t dirty[NUM_PAGES];
+
+    // what the machine owns or is wired to on the host. a snapshot leaves
+    // these alone, so restoring one keeps the target machine's own.
+    SoundState sound;
+
+    // keys sampled just in time (controls.h): the word of held keys a
+    // front end's input thread writes, NULL if the front end calls
+    // key_down and key_up itself
+    const atomic_uint *keys;
+
+    // called with data after the game reads a player input port, once the
+    // keys are sampled. NULL for none. --latency uses it (latency.h).
+    void (*input_hook)(SpaceInvadersMachine *machine, uint8_t port, void *data);
+    void *input_hook_data;
+
+    // lines changed since the screen was last drawn. the display clears them.
+    uint8_t dirty_lines[NUM_LINES];
+
+    // address space of the machine (ROM + RAM)
+    _Alignas(CACHE_LINE) uint8_t memory[MEM_SIZE];
+
+} SpaceInvadersMachine;
+
+// emulated time in cpu cycles since the machine was reset. kept up to date
+// while an instruction runs, so port writes can be timed by it.
+static inline uint64_t machine_cycles(const SpaceInvadersMachine *machine)
+{
+    return machine->frameStart + machine->frameCycles;
+}
+
+// allocate a zeroed machine in one cache-line aligned block. returns NULL on failure.
+SpaceInvadersMachine *machine_create(void);
+
+// reset the CPU, ports, timers and RAM. loaded ROM images are kept.
+void machine_reset(SpaceInvadersMachine *machine);
+
+// 64-bit hash of everything that decides how the machine runs from here:
+// registers, flags, memory, ports, shift register and the position in the
+// frame (see run_frame). the memory part is kept up to date on every write,
+// so this is cheap enough to call after every frame. wall clock timers
+// used by run_cpu are not included.
+uint64_t machine_hash(const SpaceInvadersMachine *machine);
+
+// saved copy of a machine for tree search and rewinding. snapshots keep
+// memory as shared pages, so taking one only copies the pages written since
+// the machine was last restored (or a few snapshots back), and restoring one
+// only copies the pages that differ. memory has to be changed with
+// write_byte (or mem_write) for that to work. a machine and its snapshots
+// must stay on one thread, the reference counts are not atomic. returns NULL
+// on failure, leaving the machine as it was.
+typedef struct MachineSnapshot MachineSnapshot;
+MachineSnapshot *machine_snapshot(SpaceInvadersMachine *machine);
+
+// make machine an exact copy of the machine the snapshot was taken from,
+// apart from its own sound, keys and input hook. the snapshot can be
+// restored any number of times, into any machine.
+void machine_restore(SpaceInvadersMachine *machine, const MachineSnapshot *snapshot);
+
+void snapshot_destroy(MachineSnapshot *snapshot);
+
+// free a machine created with machine_create.
+void machine_destroy(SpaceInvadersMachine *machine);
+
+#endif /* MACHINE_H */
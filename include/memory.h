@@ -1,21 +1,112 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
-// 16K buffer (sufficient for Space Invaders)
-#define MEM_SIZE 0x4FFF
+#include <stdint.h>
 
-// global memory buffer
-// instructions/operands are unsigned chars
-extern unsigned char memory[MEM_SIZE];
+// full 8080 address space. the games only use the low 20K, but 16-bit
+// addresses computed by the CPU can land anywhere.
+#define MEM_SIZE 0x10000
+
+// work RAM + video RAM
+#define RAM_START 0x2000
+#define RAM_END 0x4000
+
+// video RAM, 224 screen columns of 32 bytes
+#define VRAM_START 0x2400
+
+// the display tracks writes in 32 byte lines. a line of video RAM is one
+// screen column, so a dirty line is a column to redraw.
+#define LINE_SHIFT 5
+#define LINE_SIZE (1 << LINE_SHIFT)
+#define NUM_LINES (MEM_SIZE >> LINE_SHIFT)
+
+// snapshots keep memory as 256 byte pages. a page is only copied when the
+// machine wrote to it since the last snapshot, and snapshots share the
+// pages they have in common (ROM, and most of RAM between two frames).
+#define PAGE_SHIFT 8
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define NUM_PAGES (MEM_SIZE >> PAGE_SHIFT)
+
+// the pages are found through a two level table of 16 groups of 16 pages.
+// tables and groups are never changed once made, so a snapshot shares the
+// table of the one before it and only makes new groups where pages changed.
+#define GROUP_SHIFT 4
+#define GROUP_PAGES (1 << GROUP_SHIFT)
+#define NUM_GROUPS (NUM_PAGES >> GROUP_SHIFT)
+
+typedef struct MemPage
+{
+    int refs; // groups using this page, freed at 0
+    uint8_t data[PAGE_SIZE];
+} MemPage;
+
+typedef struct PageGroup
+{
+    int refs; // tables using this group, freed at 0
+    MemPage *page[GROUP_PAGES];
+} PageGroup;
+
+typedef struct PageTable
+{
+    int refs; // snapshots and machines using this table, freed at 0
+    PageGroup *group[NUM_GROUPS];
+} PageTable;
+
+// shared page, group and table of zeros for memory nothing has written to
+// yet. they are never reference counted or freed.
+extern MemPage zero_page;
+extern PageTable zero_table;
+
+static inline const MemPage *table_page(const PageTable *table, int page)
+{
+    return table->group[page >> GROUP_SHIFT]->page[page & (GROUP_PAGES - 1)];
+}
+
+// 64-bit mixer (murmur3 finalizer)
+static inline uint64_t hash_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// zobrist key of one memory byte. the memory hash is the XOR of the keys
+// of every byte, so a write only has to swap the old key for the new one.
+// zero bytes have no key, so empty memory hashes to 0.
+static inline uint64_t mem_key(uint16_t address, uint8_t value)
+{
+    return value ? hash_mix(((uint64_t)address << 8) | value) : 0;
+}
+
+typedef struct SpaceInvadersMachine SpaceInvadersMachine;
+
+// games that can be loaded, in the order of the game selection menu
+enum games
+{
+    GAME_INVADERS,
+    GAME_INVADERS_DX,
+    GAME_LRESCUE,
+    GAME_BALLOON,
+    NUM_GAMES
+};
 
 // function declarations
-void load_file(char *file, int address);
-unsigned char mem_read(int address);
-void mem_write(int address, unsigned char byte);
-void mem_init();
-void mem_init_dx();
-void mem_init_lrescue();
-void mem_init_balloon();
-void print_memory();
-
-#endif /* MEMORY_H */
\ No newline at end of file
+// the load/init functions return 0 on success and -1 if a ROM file is missing
+int load_file(SpaceInvadersMachine *machine, char *file, int address);
+unsigned char mem_read(SpaceInvadersMachine *machine, int address);
+void mem_write(SpaceInvadersMachine *machine, int address, unsigned char byte);
+int mem_init(SpaceInvadersMachine *machine);
+int mem_init_dx(SpaceInvadersMachine *machine);
+int mem_init_lrescue(SpaceInvadersMachine *machine);
+int mem_init_balloon(SpaceInvadersMachine *machine);
+int mem_init_game(SpaceInvadersMachine *machine, int game);
+void mem_clear(SpaceInvadersMachine *machine, int start, int end);
+// hash all of memory from scratch. the same value as state.mem_hash, which
+// is kept up to date on every write.
+uint64_t mem_hash(SpaceInvadersMachine *machine);
+void print_memory(SpaceInvadersMachine *machine);
+
+#endif /* MEMORY_H */
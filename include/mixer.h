@@ -0,0 +1,93 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <stdint.h>
+
+// sample mixer for the game sounds. the samples are converted once when they
+// are loaded, so mixing is only adding 16-bit mono samples with saturation.
+// the emulation thread starts and stops sounds through a lock-free queue and
+// neither thread ever waits for the other. needs no SDL; sounds.c connects
+// it to an SDL audio device.
+//
+// every command carries the emulated time it happened at, counted in output
+// samples. the audio thread plays emulated time MIX_LATENCY samples behind
+// the first command it saw, so a sound starts at exactly the sample its
+// port write asks for, however the emulation is batched.
+
+// output format: 16-bit mono at MIX_RATE
+#define MIX_RATE 44100
+
+#define MIX_SOUNDS 32 // sounds that can be loaded
+#define MIX_VOICES 8  // sounds that can play at the same time
+#define MIX_QUEUE 64  // commands waiting for the audio thread
+
+// how far behind emulated time the output runs. it covers a frame of
+// emulation (735 samples) done in one go plus an audio buffer.
+#define MIX_LATENCY 1024
+
+// commands later than MIX_LATENCY or more than MIX_RESYNC samples early
+// move the output to MIX_LATENCY behind them again (the emulation stalled,
+// or its clock and the sound card's drifted apart)
+#define MIX_RESYNC (8 * MIX_LATENCY)
+
+// --audio-pace: the emulation follows the sound card's clock instead of the
+// host's. after each frame it looks at how far emulated time is ahead of
+// the output and makes the next frame up to MIX_PACE_PPM longer or shorter
+// to hold that at MIX_LATENCY. the two clocks differ by far less than 0.5%,
+// so the output never has to resync, however long the game runs.
+#define MIX_PACE_PPM 5000
+#define MIX_PACE_RANGE (MIX_LATENCY / 2) // lead error that gets the full correction
+
+typedef struct Mixer Mixer;
+
+Mixer *mixer_create(void);
+void mixer_destroy(Mixer *mixer);
+
+// copy length samples (MIX_RATE, mono) into the bank as sound number sound.
+// only while nothing is being mixed. returns 0 on success and -1 on failure.
+int mixer_load(Mixer *mixer, int sound, const int16_t *samples, int length);
+
+// map a bank file (bank.h) and play its sounds from the mapping, in place
+// of any loaded before. only while nothing is being mixed, and only once.
+// returns the number of sounds in it, or -1 if it can't be used.
+int mixer_load_bank(Mixer *mixer, const char *path);
+
+// emulation thread: start a sound at emulated time at (in samples, never
+// going back), looping until stopped if loop is set, or stop every voice
+// playing it. a sound that is playing already starts again on another
+// voice. return -1 if the queue was full and the command dropped.
+int mixer_play(Mixer *mixer, int sound, int loop, uint64_t at);
+int mixer_stop(Mixer *mixer, int sound, uint64_t at);
+
+// emulation thread: the game wrote value to sound port 3 or 5 at emulated
+// time at. the mixer's synthesizer (synth.h) plays the sounds the port bits
+// ask for, alongside any samples. returns -1 if the queue was full.
+int mixer_port(Mixer *mixer, int port, uint8_t value, uint64_t at);
+
+// emulation thread: emulated time has reached at. starts and stops nothing,
+// but keeps the output following emulated time while no sound is playing.
+// returns -1 if the queue was full.
+int mixer_mark(Mixer *mixer, uint64_t at);
+
+// emulated time of the next sample to be mixed, or -1 until the first
+// command has been mixed. any thread.
+int64_t mixer_played(Mixer *mixer);
+
+// emulation thread: how long to make the next frame of frame_ns nanoseconds
+// so that emulated time at (the end of the frame just run) stays MIX_LATENCY
+// samples ahead of the output. frame_ns until the output is playing.
+long long mixer_pace(Mixer *mixer, uint64_t at, long long frame_ns);
+
+// audio thread: mix the next frames samples, applying each queued command
+// at its own sample
+void mixer_render(Mixer *mixer, int16_t *out, int frames);
+
+// audio thread: play emulated time at from the next sample mixed on,
+// instead of MIX_LATENCY behind the first command. for offline rendering,
+// where nothing runs ahead of the output.
+void mixer_sync(Mixer *mixer, uint64_t at);
+
+// plain C version of mixer_render. the SSE2 loop must match it exactly.
+void mixer_render_scalar(Mixer *mixer, int16_t *out, int frames);
+
+#endif /* MIXER_H */
@@ -0,0 +1,23 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <stdint.h>
+
+// the games only draw white; the cabinets put strips of coloured film over
+// the monitor. a strip covers screen rows top .. bottom (0 = top of the
+// upright screen), across the whole width.
+typedef struct OverlayStrip
+{
+    uint8_t top;
+    uint8_t bottom;
+    uint32_t color; // ARGB8888
+} OverlayStrip;
+
+#define MAX_STRIPS 4
+
+// fill row_color with the colour of every source row (0 = bottom, as
+// video_render expects) for a game from enum games: white, with the
+// game's strips on top
+void overlay_rows(uint32_t *row_color, int game);
+
+#endif /* OVERLAY_H */
@@ -1,10 +1,56 @@
-
 #ifndef PORTS_H
 #define PORTS_H
 
 #include "controls.h"
+#include "machine.h"
+
+// IN and OUT go through a table of 256 handlers per machine type (enum
+// games), built from the game's port maps (games.h). a port the game
+// doesn't use reads 0 and ignores writes, and says so once.
+typedef uint8_t (*InputFn)(SpaceInvadersMachine *machine, uint8_t port);
+typedef void (*OutputFn)(SpaceInvadersMachine *machine, uint8_t port, uint8_t value);
+
+typedef struct PortTable
+{
+    InputFn in[256];
+    OutputFn out[256];
+    // the shift register's ports, which step_cpu handles inline without a
+    // call: the sprite code hits them for every byte it draws. -1 on a
+    // board without one.
+    int shift_result;
+    int shift_data;
+    int shift_offset;
+} PortTable;
+
+// the handler table of game (enum games)
+const PortTable *port_table(int game);
+
+// wire machine up as game: its ports, keys and sounds. the mem_init
+// functions call it, so a machine runs with the table it was loaded with
+// and step_cpu doesn't look it up on every IN and OUT. to give one machine
+// handlers of its own, point its ports at a copy of the table.
+void port_select(SpaceInvadersMachine *machine, int game);
 
 uint8_t input_port(SpaceInvadersMachine *machine, uint8_t port);
-uint8_t output_port(SpaceInvadersMachine *machine, uint8_t port, uint8_t value);
+void output_port(SpaceInvadersMachine *machine, uint8_t port, uint8_t value);
+
+// the external shift register: the top byte of the last two bytes written,
+// shifted left by the offset
+static inline uint8_t shift_result(const SpaceInvadersMachine *machine)
+{
+    uint16_t v = (machine->shift1 << 8) | machine->shift0;
+    return (v >> (8 - machine->shift_offset)) & 0xff;
+}
+
+static inline void shift_data(SpaceInvadersMachine *machine, uint8_t value)
+{
+    machine->shift0 = machine->shift1;
+    machine->shift1 = value;
+}
+
+static inline void shift_offset(SpaceInvadersMachine *machine, uint8_t value)
+{
+    machine->shift_offset = value & 0x7;
+}
 
-#endif /* PORTS_H */
\ No newline at end of file
+#endif /* PORTS_H */
@@ -4,6 +4,8 @@
 #include <inttypes.h>
 #include <stdint.h>
 
+#include "memory.h"
+
 // ref: http://www.emulator101.com/emulator-shell.html
 
 // set up struct for CPU condition codes
@@ -30,10 +32,26 @@ typedef struct State8080
     uint16_t sp;
     uint16_t pc;
     uint8_t *memory;
+    uint8_t *dirty; // one flag per memory page, set on every write (see machine_snapshot)
+    uint8_t *dirty_lines; // one flag per 32 byte line, set on every write (see draw_screen)
+    uint64_t mem_hash; // XOR of mem_key() over all of memory, see machine_hash
     struct ConditionCodes cc;
     uint8_t int_enable;
 } State8080;
 
+// store a byte, update the memory hash and mark the page as changed
+static inline void write_byte(State8080 *state, uint16_t address, uint8_t value)
+{
+    uint8_t old = state->memory[address];
+    if (old != value)
+    {
+        state->mem_hash ^= mem_key(address, old) ^ mem_key(address, value);
+    }
+    state->memory[address] = value;
+    state->dirty[address >> PAGE_SHIFT] = 1;
+    state->dirty_lines[address >> LINE_SHIFT] = 1;
+}
+
 // quit the program for every opcode with an error
 void unimplemented_instruction(State8080 *state);
 
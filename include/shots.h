@@ -0,0 +1,42 @@
+#ifndef SHOTS_H
+#define SHOTS_H
+
+#include <stdint.h>
+
+// screenshots and video of the overlaid screen, written by a background
+// thread so the emulation never waits for an encoder or the disk. frames are
+// queued as a copy of the video memory and turned into pixels on the writer
+// thread.
+
+enum shot_formats
+{
+    SHOT_PPM, // one file per frame
+    SHOT_PNG,
+    SHOT_Y4M  // every frame queued goes into one YUV4MPEG2 (4:4:4) stream
+};
+
+// frames waiting to be written. queueing only blocks once the writer is
+// this far behind.
+#define SHOT_QUEUE 32
+
+typedef struct ShotWriter ShotWriter;
+
+// start a writer. files are named <prefix><frame>.ppm or .png, the frame
+// number padded to 6 digits. a video stream goes to the file prefix, or to
+// stdout if it is "-". game (enum games) picks the colour overlay and every
+// pixel becomes scale x scale pixels. returns NULL on failure.
+ShotWriter *shots_start(const char *prefix, int format, int game, int scale);
+
+// queue the screen in vram (VRAM_SIZE bytes) as frame number frame. waits
+// for the writer if the queue is full, so no frame is lost.
+void shots_queue(ShotWriter *writer, int frame, const uint8_t *vram);
+
+// the same, but never waits: returns -1 without queueing the frame if the
+// queue is full, and 0 otherwise. for callers that have to keep real time.
+int shots_try_queue(ShotWriter *writer, int frame, const uint8_t *vram);
+
+// write everything still queued and stop the writer. returns the number of
+// files or video frames that could not be written.
+int shots_finish(ShotWriter *writer);
+
+#endif /* SHOTS_H */
@@ -2,10 +2,15 @@
 #define SOUNDS_H
 
 #include <SDL2/SDL.h>
-#include <SDL_mixer.h>
 #include "controls.h"
 
-void init_sounds();
-void play_sounds(SpaceInvadersMachine *machine);
+// samples mixed per audio callback, about 6 ms at 44.1 kHz
+#define AUDIO_FRAMES 256
+
+// load the samples for game (enum games) into a mixer, or with synth set
+// synthesize the sounds instead, and start an audio device playing it. the
+// game runs without sound if that fails.
+void init_sounds(SpaceInvadersMachine *machine, int game, int synth);
+void close_sounds(SpaceInvadersMachine *machine);
 
 #endif /* SOUNDS_H */
\ No newline at end of file
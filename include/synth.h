@@ -0,0 +1,62 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdint.h>
+
+// synthesized sound board: instead of playing recorded samples, model the
+// circuits behind the sound port bits. every sound is a square wave and/or
+// noise through a one-pole low-pass filter with its own envelope, and the
+// eight of them are computed side by side as the eight lanes of one SSE2
+// register. the envelopes and pitches follow the port bits the way the
+// board's timers do: some sounds last as long as their bit is set, others
+// are started by the bit going on and die away on their own.
+//
+// the mixer owns one and feeds it the port writes at the sample they
+// happened at (mixer_port), so it needs no files and a few hundred bytes.
+
+#define SYNTH_LANES 8
+
+// samples between updates of the envelopes and pitches, about 1.5 ms
+#define SYNTH_STEP 64
+
+typedef struct SynthChannel
+{
+    int gate; // its port bit is set
+    int age;  // steps since it was started
+    int env;  // envelope, 0-32767
+    int note; // fleet movement: which of the four notes
+} SynthChannel;
+
+typedef struct Synth
+{
+    // one lane per sound, updated every sample
+    int16_t phase[SYNTH_LANES]; // square wave, negative for the low half
+    int16_t step[SYNTH_LANES];  // phase step per sample
+    int16_t tone[SYNTH_LANES];  // square wave into the filter (1/32768ths)
+    int16_t noise[SYNTH_LANES]; // noise into the filter
+    int16_t cutoff[SYNTH_LANES]; // filter coefficient (1/65536ths)
+    int16_t filtered[SYNTH_LANES];
+    int16_t level[SYNTH_LANES]; // output gain (1/32768ths)
+    uint16_t lfsr;              // noise generator
+
+    // updated every SYNTH_STEP samples
+    SynthChannel channel[SYNTH_LANES];
+    uint8_t port3;
+    uint8_t port5;
+    int countdown; // samples to the next update
+    int silent;    // every level is 0
+} Synth;
+
+void synth_init(Synth *synth);
+
+// a write of value to sound port 3 or 5
+void synth_port(Synth *synth, int port, uint8_t value);
+
+// write the next frames samples to out. returns 0, leaving out untouched,
+// if all of them are silent.
+int synth_render(Synth *synth, int16_t *out, int frames);
+
+// plain C version of synth_render. the SSE2 loop must match it exactly.
+int synth_render_scalar(Synth *synth, int16_t *out, int frames);
+
+#endif /* SYNTH_H */
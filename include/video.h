@@ -0,0 +1,41 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <stdint.h>
+
+// the screen as the game sees it: 224 columns of 256 pixels, stored as
+// 32 bytes per column from the bottom up, bit 0 lowest
+#define SCREEN_WIDTH 224
+#define SCREEN_HEIGHT 256
+#define VRAM_SIZE (SCREEN_WIDTH * SCREEN_HEIGHT / 8)
+
+// convert the 1bpp video memory into 32-bit pixels, upright.
+// the output is 224 * scale x 256 * scale pixels, pitch bytes apart. every
+// source pixel becomes scale pixels across on one output row and the other
+// scale - 1 rows are cleared. row_color[r] is the colour of source row r,
+// counting from the bottom, so an overlay is just a table of colours.
+// picks an SSE2 or AVX2 kernel at runtime where the CPU has one.
+void video_render(uint32_t *pixels, int pitch, const uint8_t *vram, const uint32_t *row_color, int scale);
+
+// video_render for columns x .. x + width - 1 only. the vector kernels work
+// on groups of 16 or 32 columns and may draw a few columns either side.
+void video_render_columns(uint32_t *pixels, int pitch, const uint8_t *vram, const uint32_t *row_color, int scale,
+                          int x, int width);
+
+// plain C version of video_render. the SIMD kernels must match it exactly.
+void video_render_scalar(uint32_t *pixels, int pitch, const uint8_t *vram, const uint32_t *row_color, int scale);
+
+// dirty columns closer together than this are drawn as one run
+#define RUN_GAP 8
+#define MAX_RUNS ((SCREEN_WIDTH + RUN_GAP) / (RUN_GAP + 1))
+
+// find the next run of dirty columns at or after *x in columns (one flag per
+// column, as kept by the memory write path). sets *x to its first column,
+// clears its flags and returns its width, or 0 when nothing is dirty.
+// there are at most MAX_RUNS runs per screen.
+int video_next_run(uint8_t *columns, int *x);
+
+// name of the kernel video_render uses on this machine
+const char *video_kernel(void);
+
+#endif /* VIDEO_H */
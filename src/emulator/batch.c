@@ -0,0 +1,899 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "interrupts.h"
+#include "memory.h"
+
+// loop over every lane and only update the ones in the group. written as a
+// select so the compiler turns it into a vector blend.
+#define LANES for (int i = 0; i < BATCH_LANES; i++)
+#define SEL(reg, value) (reg)[i] = mask[i] ? (value) : (reg)[i]
+
+// set z, s and p from an 8-bit result, as processor.c does
+#define SEL_ZSP(value)                    \
+    do                                    \
+    {                                     \
+        uint8_t r_ = (value);             \
+        SEL(bt->z, r_ == 0);              \
+        SEL(bt->s, r_ >> 7);              \
+        SEL(bt->p, even_parity(r_));      \
+    } while (0)
+
+static inline uint8_t even_parity(uint8_t x)
+{
+    x ^= x >> 4;
+    x ^= x >> 2;
+    x ^= x >> 1;
+    return (~x) & 1;
+}
+
+// copy a lane from the SoA registers into its machine and back
+static void lane_store(Batch *bt, int i)
+{
+    State8080 *state = &bt->machine[i]->state;
+    state->a = bt->a[i];
+    state->b = bt->b[i];
+    state->c = bt->c[i];
+    state->d = bt->d[i];
+    state->e = bt->e[i];
+    state->h = bt->h[i];
+    state->l = bt->l[i];
+    state->sp = bt->sp[i];
+    state->pc = bt->pc[i];
+    state->cc.z = bt->z[i];
+    state->cc.s = bt->s[i];
+    state->cc.p = bt->p[i];
+    state->cc.cy = bt->cy[i];
+    state->cc.ac = bt->ac[i];
+    state->int_enable = bt->int_enable[i];
+}
+
+static void lane_load(Batch *bt, int i)
+{
+    State8080 *state = &bt->machine[i]->state;
+    bt->a[i] = state->a;
+    bt->b[i] = state->b;
+    bt->c[i] = state->c;
+    bt->d[i] = state->d;
+    bt->e[i] = state->e;
+    bt->h[i] = state->h;
+    bt->l[i] = state->l;
+    bt->sp[i] = state->sp;
+    bt->pc[i] = state->pc;
+    bt->z[i] = state->cc.z;
+    bt->s[i] = state->cc.s;
+    bt->p[i] = state->cc.p;
+    bt->cy[i] = state->cc.cy;
+    bt->ac[i] = state->cc.ac;
+    bt->int_enable[i] = state->int_enable;
+}
+
+Batch *batch_create(SpaceInvadersMachine **machines, int count)
+{
+    if (count < 1 || count > BATCH_LANES)
+    {
+        return NULL;
+    }
+    Batch *bt = aligned_alloc(CACHE_LINE, (sizeof(Batch) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+    if (bt == NULL)
+    {
+        return NULL;
+    }
+    memset(bt, 0, sizeof(Batch));
+    bt->count = count;
+
+    // code is only fetched once per group, which needs the same program in every lane
+    bt->shared_rom = 1;
+    for (int i = 0; i < BATCH_LANES; i++)
+    {
+        bt->machine[i] = machines[i < count ? i : 0];
+        bt->mem[i] = bt->machine[i]->memory;
+        if (memcmp(bt->mem[i], bt->mem[0], RAM_START) != 0)
+        {
+            bt->shared_rom = 0;
+        }
+    }
+    return bt;
+}
+
+void batch_destroy(Batch *bt)
+{
+    free(bt);
+}
+
+// opcodes with a vector version in vector_step. branches are marked
+// separately since the lanes may split on them.
+#define BRANCH 2
+static const uint8_t vector_supported[256] = {
+    [0x00] = 1, [0x01] = 1, [0x03] = 1, [0x05] = 1, [0x06] = 1, [0x0b] = 1, [0x0c] = 1, [0x0d] = 1,
+    [0x0e] = 1, [0x0f] = 1, [0x11] = 1, [0x13] = 1, [0x14] = 1, [0x15] = 1, [0x16] = 1, [0x1b] = 1,
+    [0x1c] = 1, [0x1d] = 1, [0x1e] = 1, [0x21] = 1, [0x23] = 1, [0x24] = 1, [0x25] = 1, [0x26] = 1,
+    [0x2b] = 1, [0x2c] = 1, [0x2d] = 1, [0x2e] = 1, [0x3a] = 1, [0x3d] = 1, [0x3e] = 1, [0x47] = 1,
+    [0x4f] = 1, [0x57] = 1, [0x5f] = 1, [0x67] = 1, [0x6f] = 1, [0x78] = 1, [0x79] = 1, [0x7a] = 1,
+    [0x7b] = 1, [0x7c] = 1, [0x7d] = 1, [0x7e] = 1, [0xa0] = 1, [0xa1] = 1, [0xa7] = 1, [0xaf] = 1,
+    [0xe6] = 1, [0xfe] = 1, [0x09] = 1, [0x19] = 1, [0x29] = 1, [0x0a] = 1, [0x1a] = 1, [0x1f] = 1,
+    [0x32] = 1, [0x36] = 1, [0x46] = 1, [0x4e] = 1, [0x56] = 1, [0x5e] = 1, [0x66] = 1, [0x6e] = 1,
+    [0x77] = 1, [0xb0] = 1, [0xb1] = 1, [0xc6] = 1, [0xc1] = 1, [0xd1] = 1, [0xe1] = 1, [0xc5] = 1,
+    [0xd5] = 1, [0xe5] = 1,
+    [0xc2] = BRANCH, [0xc3] = BRANCH, [0xca] = BRANCH, [0xd2] = BRANCH, [0xda] = BRANCH,
+    [0xcd] = BRANCH, [0xc9] = BRANCH, [0xc0] = BRANCH, [0xc8] = BRANCH, [0xd0] = BRANCH, [0xd8] = BRANCH,
+};
+
+// execute the instruction at opcode for every lane in mask.
+// only called for opcodes marked in vector_supported. -O2 only vectorizes
+// trivial loops, so the lane loops here ask for the full vectorizer.
+__attribute__((target_clones("avx2", "default"), optimize("O3")))
+static void vector_step(Batch *bt, const uint8_t *mask, const uint8_t *opcode)
+{
+    uint16_t imm16 = (opcode[2] << 8) | opcode[1];
+    uint8_t imm8 = opcode[1];
+    int length = 1;
+    int cycles;
+
+    switch (opcode[0])
+    {
+    case 0x00: // NOP
+        cycles = 4;
+        break;
+
+    // LXI B/D/H
+    case 0x01:
+        LANES
+        {
+            SEL(bt->b, opcode[2]);
+            SEL(bt->c, imm8);
+        }
+        length = 3;
+        cycles = 10;
+        break;
+    case 0x11:
+        LANES
+        {
+            SEL(bt->d, opcode[2]);
+            SEL(bt->e, imm8);
+        }
+        length = 3;
+        cycles = 10;
+        break;
+    case 0x21:
+        LANES
+        {
+            SEL(bt->h, opcode[2]);
+            SEL(bt->l, imm8);
+        }
+        length = 3;
+        cycles = 10;
+        break;
+
+    // INX and DCX B/D/H
+    case 0x03:
+    case 0x0b:
+    {
+        uint16_t delta = opcode[0] == 0x03 ? 1 : 0xffff;
+        LANES
+        {
+            uint16_t v = ((bt->b[i] << 8) | bt->c[i]) + delta;
+            SEL(bt->b, v >> 8);
+            SEL(bt->c, v & 0xff);
+        }
+        cycles = 5;
+        break;
+    }
+    case 0x13:
+    case 0x1b:
+    {
+        uint16_t delta = opcode[0] == 0x13 ? 1 : 0xffff;
+        LANES
+        {
+            uint16_t v = ((bt->d[i] << 8) | bt->e[i]) + delta;
+            SEL(bt->d, v >> 8);
+            SEL(bt->e, v & 0xff);
+        }
+        cycles = 5;
+        break;
+    }
+    case 0x23:
+    case 0x2b:
+    {
+        uint16_t delta = opcode[0] == 0x23 ? 1 : 0xffff;
+        LANES
+        {
+            uint16_t v = ((bt->h[i] << 8) | bt->l[i]) + delta;
+            SEL(bt->h, v >> 8);
+            SEL(bt->l, v & 0xff);
+        }
+        cycles = 5;
+        break;
+    }
+
+    case 0x05: // DCR B - also updates AC
+        LANES
+        {
+            uint8_t v = bt->b[i] - 1;
+            SEL(bt->ac, ((bt->b[i] & 0x0f) == 0x00) && ((v & 0x0f) == 0x0f));
+            SEL(bt->b, v);
+            SEL_ZSP(v);
+        }
+        cycles = 5;
+        break;
+
+    // INR/DCR C, D, E, H, L and DCR A - z, s, p only
+    case 0x0c:
+    case 0x0d:
+    {
+        uint8_t delta = opcode[0] == 0x0c ? 1 : 0xff;
+        LANES
+        {
+            uint8_t v = bt->c[i] + delta;
+            SEL(bt->c, v);
+            SEL_ZSP(v);
+        }
+        cycles = 5;
+        break;
+    }
+    case 0x14:
+    case 0x15:
+    {
+        uint8_t delta = opcode[0] == 0x14 ? 1 : 0xff;
+        LANES
+        {
+            uint8_t v = bt->d[i] + delta;
+            SEL(bt->d, v);
+            SEL_ZSP(v);
+        }
+        cycles = 5;
+        break;
+    }
+    case 0x1c:
+    case 0x1d:
+    {
+        uint8_t delta = opcode[0] == 0x1c ? 1 : 0xff;
+        LANES
+        {
+            uint8_t v = bt->e[i] + delta;
+            SEL(bt->e, v);
+            SEL_ZSP(v);
+        }
+        cycles = 5;
+        break;
+    }
+    case 0x24:
+    case 0x25:
+    {
+        uint8_t delta = opcode[0] == 0x24 ? 1 : 0xff;
+        LANES
+        {
+            uint8_t v = bt->h[i] + delta;
+            SEL(bt->h, v);
+            SEL_ZSP(v);
+        }
+        cycles = 5;
+        break;
+    }
+    case 0x2c:
+    case 0x2d:
+    {
+        uint8_t delta = opcode[0] == 0x2c ? 1 : 0xff;
+        LANES
+        {
+            uint8_t v = bt->l[i] + delta;
+            SEL(bt->l, v);
+            SEL_ZSP(v);
+        }
+        cycles = 5;
+        break;
+    }
+    case 0x3d:
+        LANES
+        {
+            uint8_t v = bt->a[i] - 1;
+            SEL(bt->a, v);
+            SEL_ZSP(v);
+        }
+        cycles = 5;
+        break;
+
+    // MVI r, byte
+    case 0x06:
+        LANES SEL(bt->b, imm8);
+        length = 2;
+        cycles = 7;
+        break;
+    case 0x0e:
+        LANES SEL(bt->c, imm8);
+        length = 2;
+        cycles = 7;
+        break;
+    case 0x16:
+        LANES SEL(bt->d, imm8);
+        length = 2;
+        cycles = 7;
+        break;
+    case 0x1e:
+        LANES SEL(bt->e, imm8);
+        length = 2;
+        cycles = 7;
+        break;
+    case 0x26:
+        LANES SEL(bt->h, imm8);
+        length = 2;
+        cycles = 7;
+        break;
+    case 0x2e:
+        LANES SEL(bt->l, imm8);
+        length = 2;
+        cycles = 7;
+        break;
+    case 0x3e:
+        LANES SEL(bt->a, imm8);
+        length = 2;
+        cycles = 7;
+        break;
+
+    case 0x0f: // RRC
+        LANES
+        {
+            uint8_t x = bt->a[i];
+            SEL(bt->a, (uint8_t)((x << 7) | (x >> 1)));
+            SEL(bt->cy, x & 1);
+        }
+        cycles = 4;
+        break;
+
+    // MOV between A and the other registers
+    case 0x47:
+        LANES SEL(bt->b, bt->a[i]);
+        cycles = 5;
+        break;
+    case 0x4f:
+        LANES SEL(bt->c, bt->a[i]);
+        cycles = 5;
+        break;
+    case 0x57:
+        LANES SEL(bt->d, bt->a[i]);
+        cycles = 5;
+        break;
+    case 0x5f:
+        LANES SEL(bt->e, bt->a[i]);
+        cycles = 5;
+        break;
+    case 0x67:
+        LANES SEL(bt->h, bt->a[i]);
+        cycles = 5;
+        break;
+    case 0x6f:
+        LANES SEL(bt->l, bt->a[i]);
+        cycles = 5;
+        break;
+    case 0x78:
+        LANES SEL(bt->a, bt->b[i]);
+        cycles = 5;
+        break;
+    case 0x79:
+        LANES SEL(bt->a, bt->c[i]);
+        cycles = 5;
+        break;
+    case 0x7a:
+        LANES SEL(bt->a, bt->d[i]);
+        cycles = 5;
+        break;
+    case 0x7b:
+        LANES SEL(bt->a, bt->e[i]);
+        cycles = 5;
+        break;
+    case 0x7c:
+        LANES SEL(bt->a, bt->h[i]);
+        cycles = 5;
+        break;
+    case 0x7d:
+        LANES SEL(bt->a, bt->l[i]);
+        cycles = 5;
+        break;
+
+    // loads from each lane's own memory
+    case 0x7e: // MOV A,M
+        LANES SEL(bt->a, bt->mem[i][(bt->h[i] << 8) | bt->l[i]]);
+        cycles = 7;
+        break;
+    case 0x3a: // LDA addr
+        LANES SEL(bt->a, bt->mem[i][imm16]);
+        length = 3;
+        cycles = 13;
+        break;
+
+    // logical ops clear CY and AC
+    case 0xa0:
+    case 0xa1:
+    case 0xa7:
+    case 0xaf:
+        LANES
+        {
+            uint8_t v;
+            if (opcode[0] == 0xa0)
+                v = bt->a[i] & bt->b[i];
+            else if (opcode[0] == 0xa1)
+                v = bt->a[i] & bt->c[i];
+            else if (opcode[0] == 0xa7)
+                v = bt->a[i];
+            else
+                v = 0;
+            SEL(bt->a, v);
+            SEL_ZSP(v);
+            SEL(bt->cy, 0);
+            SEL(bt->ac, 0);
+        }
+        cycles = 4;
+        break;
+    case 0xe6: // ANI - leaves AC alone
+        LANES
+        {
+            uint8_t v = bt->a[i] & imm8;
+            SEL(bt->a, v);
+            SEL_ZSP(v);
+            SEL(bt->cy, 0);
+        }
+        length = 2;
+        cycles = 7;
+        break;
+    case 0xfe: // CPI
+        LANES
+        {
+            uint8_t v = bt->a[i] - imm8;
+            SEL_ZSP(v);
+            SEL(bt->cy, bt->a[i] < imm8);
+        }
+        length = 2;
+        cycles = 7;
+        break;
+
+    case 0x1f: // RAR
+        LANES
+        {
+            uint8_t x = bt->a[i];
+            SEL(bt->a, (uint8_t)((bt->cy[i] << 7) | (x >> 1)));
+            SEL(bt->cy, x & 1);
+        }
+        cycles = 4;
+        break;
+
+    // DAD B/D/H - only CY changes
+    case 0x09:
+    case 0x19:
+    case 0x29:
+        LANES
+        {
+            uint32_t hl = (bt->h[i] << 8) | bt->l[i];
+            uint32_t v;
+            if (opcode[0] == 0x09)
+                v = (bt->b[i] << 8) | bt->c[i];
+            else if (opcode[0] == 0x19)
+                v = (bt->d[i] << 8) | bt->e[i];
+            else
+                v = hl;
+            uint32_t res = hl + v;
+            SEL(bt->h, (res >> 8) & 0xff);
+            SEL(bt->l, res & 0xff);
+            SEL(bt->cy, res > 0xffff);
+        }
+        cycles = 10;
+        break;
+
+    case 0xb0: // ORA B
+    case 0xb1: // ORA C
+        LANES
+        {
+            uint8_t v = bt->a[i] | (opcode[0] == 0xb0 ? bt->b[i] : bt->c[i]);
+            SEL(bt->a, v);
+            SEL_ZSP(v);
+            SEL(bt->cy, 0);
+            SEL(bt->ac, 0);
+        }
+        cycles = 4;
+        break;
+    case 0xc6: // ADI - leaves AC alone
+        LANES
+        {
+            uint16_t x = bt->a[i] + imm8;
+            SEL_ZSP(x & 0xff);
+            SEL(bt->cy, x > 0xff);
+            SEL(bt->a, x & 0xff);
+        }
+        length = 2;
+        cycles = 7;
+        break;
+
+    // more loads
+    case 0x0a: // LDAX B
+        LANES SEL(bt->a, bt->mem[i][(bt->b[i] << 8) | bt->c[i]]);
+        cycles = 7;
+        break;
+    case 0x1a: // LDAX D
+        LANES SEL(bt->a, bt->mem[i][(bt->d[i] << 8) | bt->e[i]]);
+        cycles = 7;
+        break;
+    case 0x46: // MOV B,M
+        LANES SEL(bt->b, bt->mem[i][(bt->h[i] << 8) | bt->l[i]]);
+        cycles = 7;
+        break;
+    case 0x4e: // MOV C,M
+        LANES SEL(bt->c, bt->mem[i][(bt->h[i] << 8) | bt->l[i]]);
+        cycles = 7;
+        break;
+    case 0x56: // MOV D,M
+        LANES SEL(bt->d, bt->mem[i][(bt->h[i] << 8) | bt->l[i]]);
+        cycles = 7;
+        break;
+    case 0x5e: // MOV E,M
+        LANES SEL(bt->e, bt->mem[i][(bt->h[i] << 8) | bt->l[i]]);
+        cycles = 7;
+        break;
+    case 0x66: // MOV H,M
+        LANES SEL(bt->h, bt->mem[i][(bt->h[i] << 8) | bt->l[i]]);
+        cycles = 7;
+        break;
+    case 0x6e: // MOV L,M
+        LANES SEL(bt->l, bt->mem[i][(bt->h[i] << 8) | bt->l[i]]);
+        cycles = 7;
+        break;
+
+    // stores go to each lane's own memory, with the same checks as processor.c
+    case 0x77: // MOV M,A
+        LANES
+        {
+            uint16_t offset = (bt->h[i] << 8) | bt->l[i];
+            if (mask[i] && offset > 0x2000 && offset <= 0x4000)
+                write_byte(&bt->machine[i]->state, offset, bt->a[i]);
+        }
+        cycles = 7;
+        break;
+    case 0x36: // MVI M
+        LANES
+        {
+            if (mask[i])
+                write_byte(&bt->machine[i]->state, (bt->h[i] << 8) | bt->l[i], imm8);
+        }
+        length = 2;
+        cycles = 10;
+        break;
+    case 0x32: // STA addr
+        LANES
+        {
+            if (mask[i])
+                write_byte(&bt->machine[i]->state, imm16, bt->a[i]);
+        }
+        length = 3;
+        cycles = 13;
+        break;
+
+    // stack
+    case 0xc5:
+    case 0xd5:
+    case 0xe5: // PUSH B/D/H
+        LANES
+        {
+            if (mask[i])
+            {
+                uint8_t hi = opcode[0] == 0xc5 ? bt->b[i] : opcode[0] == 0xd5 ? bt->d[i] : bt->h[i];
+                uint8_t lo = opcode[0] == 0xc5 ? bt->c[i] : opcode[0] == 0xd5 ? bt->e[i] : bt->l[i];
+                write_byte(&bt->machine[i]->state, bt->sp[i] - 1, hi);
+                write_byte(&bt->machine[i]->state, bt->sp[i] - 2, lo);
+                bt->sp[i] -= 2;
+            }
+        }
+        cycles = 11;
+        break;
+    case 0xc1: // POP B
+        LANES
+        {
+            SEL(bt->c, bt->mem[i][bt->sp[i]]);
+            SEL(bt->b, bt->mem[i][bt->sp[i] + 1]);
+            SEL(bt->sp, (uint16_t)(bt->sp[i] + 2));
+        }
+        cycles = 10;
+        break;
+    case 0xd1: // POP D
+        LANES
+        {
+            SEL(bt->e, bt->mem[i][bt->sp[i]]);
+            SEL(bt->d, bt->mem[i][bt->sp[i] + 1]);
+            SEL(bt->sp, (uint16_t)(bt->sp[i] + 2));
+        }
+        cycles = 10;
+        break;
+    case 0xe1: // POP H
+        LANES
+        {
+            SEL(bt->l, bt->mem[i][bt->sp[i]]);
+            SEL(bt->h, bt->mem[i][bt->sp[i] + 1]);
+            SEL(bt->sp, (uint16_t)(bt->sp[i] + 2));
+        }
+        cycles = 10;
+        break;
+
+    case 0xcd: // CALL
+        LANES
+        {
+            if (mask[i])
+            {
+                uint16_t ret = bt->pc[i] + 3;
+                write_byte(&bt->machine[i]->state, bt->sp[i] - 1, (ret >> 8) & 0xff);
+                write_byte(&bt->machine[i]->state, bt->sp[i] - 2, ret & 0xff);
+                bt->sp[i] -= 2;
+                bt->pc[i] = imm16;
+                bt->cycles[i] += 17;
+            }
+        }
+        return;
+
+    // RET and the conditional returns - 10 and 11 cycles either way
+    case 0xc9:
+    case 0xc0:
+    case 0xc8:
+    case 0xd0:
+    case 0xd8:
+        LANES
+        {
+            int taken;
+            if (opcode[0] == 0xc0)
+                taken = !bt->z[i];
+            else if (opcode[0] == 0xc8)
+                taken = bt->z[i];
+            else if (opcode[0] == 0xd0)
+                taken = !bt->cy[i];
+            else if (opcode[0] == 0xd8)
+                taken = bt->cy[i];
+            else
+                taken = 1;
+            if (mask[i])
+            {
+                if (taken)
+                {
+                    bt->pc[i] = bt->mem[i][bt->sp[i]] | (bt->mem[i][bt->sp[i] + 1] << 8);
+                    bt->sp[i] += 2;
+                }
+                else
+                {
+                    bt->pc[i] += 1;
+                }
+                bt->cycles[i] += opcode[0] == 0xc9 ? 10 : 11;
+            }
+        }
+        return;
+
+    // jumps - the lanes may split here, each one picks its own PC
+    case 0xc2:
+    case 0xca:
+    case 0xd2:
+    case 0xda:
+    case 0xc3:
+        LANES
+        {
+            int taken;
+            if (opcode[0] == 0xc2)
+                taken = !bt->z[i];
+            else if (opcode[0] == 0xca)
+                taken = bt->z[i];
+            else if (opcode[0] == 0xd2)
+                taken = !bt->cy[i];
+            else if (opcode[0] == 0xda)
+                taken = bt->cy[i];
+            else
+                taken = 1;
+            SEL(bt->pc, taken ? imm16 : (uint16_t)(bt->pc[i] + 3));
+            bt->cycles[i] += mask[i] ? 10 : 0;
+        }
+        return;
+
+    default:
+        return;
+    }
+
+    LANES
+    {
+        SEL(bt->pc, (uint16_t)(bt->pc[i] + length));
+        bt->cycles[i] += mask[i] ? cycles : 0;
+    }
+}
+
+// run one lane on its own through the normal interpreter. the lane's
+// registers stay in its machine until a vector step needs them again.
+static void scalar_step(Batch *bt, int i)
+{
+    if (bt->in_soa[i])
+    {
+        lane_store(bt, i);
+        bt->in_soa[i] = 0;
+    }
+    // IN and OUT only run here, and what they time (sounds, the input
+    // hook) goes by machine_cycles(), like in run_frame
+    bt->machine[i]->frameCycles = bt->cycles[i];
+    bt->cycles[i] += step_cpu(bt->machine[i]);
+    bt->pc[i] = bt->machine[i]->state.pc;
+    bt->scalar_steps++;
+}
+
+// run every lane until it has used target cycles
+static void run_until(Batch *bt, int target)
+{
+    uint8_t mask[BATCH_LANES];
+
+    for (;;)
+    {
+        // common case first: every lane still running is at the same PC
+        uint16_t pc = bt->pc[0];
+        int group = 0;
+        int active = 0;
+        LANES
+        {
+            uint8_t running = (i < bt->count) & (bt->cycles[i] < target);
+            mask[i] = running & (bt->pc[i] == pc);
+            group += mask[i];
+            active += running;
+        }
+        if (active == 0)
+        {
+            break;
+        }
+
+        if (group != active)
+        {
+            // the lane furthest behind leads, which lets lanes that split on a
+            // branch meet up again when they rejoin the same code
+            int leader = -1;
+            int next = target;
+            for (int i = 0; i < bt->count; i++)
+            {
+                if (bt->cycles[i] >= target)
+                {
+                    continue;
+                }
+                if (leader < 0 || bt->cycles[i] < bt->cycles[leader])
+                {
+                    if (leader >= 0)
+                    {
+                        next = bt->cycles[leader];
+                    }
+                    leader = i;
+                }
+                else if (bt->cycles[i] < next)
+                {
+                    next = bt->cycles[i];
+                }
+            }
+
+            pc = bt->pc[leader];
+            group = 0;
+            LANES
+            {
+                mask[i] = (i < bt->count) & (bt->cycles[i] < target) & (bt->pc[i] == pc);
+                group += mask[i];
+            }
+
+            if (group == 1)
+            {
+                // nobody to share with - run the leader until it passes the next lane
+                do
+                {
+                    scalar_step(bt, leader);
+                } while (bt->cycles[leader] <= next && bt->cycles[leader] < target);
+                continue;
+            }
+        }
+
+        // keep running the group until it splits up or hits the target.
+        // code in ROM is the same for every lane, so one fetch serves the group.
+        int first = 0;
+        int32_t most = 0;
+        for (int i = BATCH_LANES - 1; i >= 0; i--)
+        {
+            if (mask[i])
+            {
+                first = i;
+                most = bt->cycles[i] > most ? bt->cycles[i] : most;
+            }
+        }
+
+        int loaded = 0; // group registers are current in the SoA arrays
+        for (;;)
+        {
+            const uint8_t *opcode = &bt->mem[0][pc];
+            int kind = (bt->shared_rom && pc < RAM_START) ? vector_supported[opcode[0]] : 0;
+
+            if (kind)
+            {
+                if (!loaded)
+                {
+                    LANES
+                    {
+                        if (mask[i] && !bt->in_soa[i])
+                        {
+                            lane_load(bt, i);
+                            bt->in_soa[i] = 1;
+                        }
+                    }
+                    loaded = 1;
+                }
+                int32_t before = bt->cycles[first];
+                vector_step(bt, mask, opcode);
+                most += bt->cycles[first] - before;
+                bt->vector_steps++;
+                bt->vector_lanes += group;
+                if (kind == BRANCH || most >= target)
+                {
+                    break;
+                }
+            }
+            else
+            {
+                // no vector version - step each lane, then check they still agree
+                int split = 0;
+                LANES
+                {
+                    if (mask[i])
+                    {
+                        scalar_step(bt, i);
+                        most = bt->cycles[i] > most ? bt->cycles[i] : most;
+                        split |= bt->pc[i] != bt->pc[first];
+                    }
+                }
+                loaded = 0;
+                if (split || most >= target)
+                {
+                    break;
+                }
+            }
+            pc = bt->pc[first];
+        }
+    }
+}
+
+static void interrupt_lanes(Batch *bt, int interrupt_num)
+{
+    for (int i = 0; i < bt->count; i++)
+    {
+        if (bt->in_soa[i])
+        {
+            lane_store(bt, i);
+            bt->in_soa[i] = 0;
+        }
+        State8080 *state = &bt->machine[i]->state;
+        if (state->int_enable)
+        {
+            generate_interrupt(state, interrupt_num);
+            bt->machine[i]->numInterrupts += 1;
+            bt->pc[i] = state->pc;
+        }
+    }
+}
+
+void batch_run_frame(Batch *bt)
+{
+    // the machines hold the state between frames, so callers can inspect or
+    // change them freely
+    for (int i = 0; i < BATCH_LANES; i++)
+    {
+        if (i < bt->count)
+        {
+            bt->in_soa[i] = 0;
+            bt->pc[i] = bt->machine[i]->state.pc;
+            bt->cycles[i] = bt->machine[i]->frameCycles;
+        }
+        else
+        {
+            bt->cycles[i] = FRAME_CYCLES;
+        }
+    }
+
+    // same interrupt points as run_frame
+    run_until(bt, HALF_FRAME_CYCLES);
+    interrupt_lanes(bt, 1);
+    run_until(bt, FRAME_CYCLES);
+    interrupt_lanes(bt, 2);
+
+    for (int i = 0; i < bt->count; i++)
+    {
+        bt->machine[i]->frameCycles = bt->cycles[i] - FRAME_CYCLES;
+        bt->machine[i]->frameStart += FRAME_CYCLES;
+    }
+}
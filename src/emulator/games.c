@@ -0,0 +1,115 @@
+#include "games.h"
+
+// all four games run on Midway/Taito 8080 boards with the Space Invaders
+// inputs and shift register (see computerarchaeology and MAME's 8080bw
+// driver). they differ in what the sound bits do, further down.
+//  IN 0  unused here, reads 1 (attract mode needs it)
+//  IN 1  bit 0 coin, 1 P2 start, 2 P1 start, 4 P1 shot, 5 P1 left, 6 P1 right
+//  IN 2  bit 2 tilt, 4 P2 shot, 5 P2 left, 6 P2 right (the rest are switches)
+//  IN 3  shift register result
+//  OUT 2 shift amount, OUT 4 shift data, OUT 3 and 5 sounds, OUT 6 watchdog
+
+#define INVADERS_PORTS                                                                                   \
+    .in = {[0] = IN_FIXED, [1] = IN_PLAYER1, [2] = IN_PLAYER2, [3] = IN_SHIFT},                          \
+    .out = {[2] = OUT_SHIFT_OFFSET, [3] = OUT_SOUND1, [4] = OUT_SHIFT_DATA, [5] = OUT_SOUND2,            \
+            [6] = OUT_WATCHDOG},                                                                         \
+    .fixed = 1
+
+#define INVADERS_KEYS                                                                                    \
+    .key = {                                                                                             \
+        [KEY_COIN] = {IN_PLAYER1, 0x01},                                                                 \
+        [KEY_P2_START] = {IN_PLAYER1, 0x02},                                                             \
+        [KEY_P1_START] = {IN_PLAYER1, 0x04},                                                             \
+        [KEY_P1_SHOOT] = {IN_PLAYER1, 0x10},                                                             \
+        [KEY_P1_LEFT] = {IN_PLAYER1, 0x20},                                                              \
+        [KEY_P1_RIGHT] = {IN_PLAYER1, 0x40},                                                             \
+        [KEY_TILT] = {IN_PLAYER2, 0x04},                                                                 \
+        [KEY_P2_SHOOT] = {IN_PLAYER2, 0x10},                                                             \
+        [KEY_P2_LEFT] = {IN_PLAYER2, 0x20},                                                              \
+        [KEY_P2_RIGHT] = {IN_PLAYER2, 0x40},                                                             \
+    }
+
+// port 3: bit 0 ufo (repeats), 1 shot, 2 flash (player die), 3 invader die,
+// 4 extended play (no sample), 5 amp enable
+// port 5: bits 0-3 fleet movement 1-4, bit 4 ufo hit, bit 5 cocktail flip
+#define INVADERS_SOUNDS                                                                                  \
+    .num_sounds = 9,                                                                                     \
+    .sound = {                                                                                           \
+        {OUT_SOUND1, 0x01, 0, 1},                                                                        \
+        {OUT_SOUND1, 0x02, 1, 0},                                                                        \
+        {OUT_SOUND1, 0x04, 2, 0},                                                                        \
+        {OUT_SOUND1, 0x08, 3, 0},                                                                        \
+        {OUT_SOUND2, 0x01, 4, 0},                                                                        \
+        {OUT_SOUND2, 0x02, 5, 0},                                                                        \
+        {OUT_SOUND2, 0x04, 6, 0},                                                                        \
+        {OUT_SOUND2, 0x08, 7, 0},                                                                        \
+        {OUT_SOUND2, 0x10, 8, 0},                                                                        \
+    }
+
+// the other two games' sound bits, from MAME's lrescue_sh_port and
+// ballbomb_sh_port handlers. sample is the sound of the same kind among the
+// nine Space Invaders ones, which a game's own bank can replace.
+// port 3: bit 0 thrust (held), 1 shot, 2 death, 3 alien hit, 4 bonus ship
+// port 5: bit 0 footstep high, 1 footstep low, 2 counting the men saved,
+// 3 stepping tone (no sample), 4 landing, 5 flip
+#define LRESCUE_SOUNDS                                                                                   \
+    .num_sounds = 9,                                                                                     \
+    .sound = {                                                                                           \
+        {OUT_SOUND1, 0x01, 0, 1},                                                                        \
+        {OUT_SOUND1, 0x02, 1, 0},                                                                        \
+        {OUT_SOUND1, 0x04, 2, 0},                                                                        \
+        {OUT_SOUND1, 0x08, 3, 0},                                                                        \
+        {OUT_SOUND1, 0x10, 8, 0},                                                                        \
+        {OUT_SOUND2, 0x01, 4, 0},                                                                        \
+        {OUT_SOUND2, 0x02, 5, 0},                                                                        \
+        {OUT_SOUND2, 0x04, 6, 0},                                                                        \
+        {OUT_SOUND2, 0x10, 7, 0},                                                                        \
+    }
+
+// port 3: bit 0 balloon hit, 1 shot, 2 base hit, 3 bomb hit, 4 bonus base
+// port 5: bit 0 plane about to bomb, 2 plane dropping balloons, 4 balloon
+// hit and bomb dropping, 5 flip
+#define BALLOON_SOUNDS                                                                                   \
+    .num_sounds = 8,                                                                                     \
+    .sound = {                                                                                           \
+        {OUT_SOUND1, 0x01, 3, 0},                                                                        \
+        {OUT_SOUND1, 0x02, 1, 0},                                                                        \
+        {OUT_SOUND1, 0x04, 2, 0},                                                                        \
+        {OUT_SOUND1, 0x08, 8, 0},                                                                        \
+        {OUT_SOUND1, 0x10, 6, 0},                                                                        \
+        {OUT_SOUND2, 0x01, 0, 0},                                                                        \
+        {OUT_SOUND2, 0x04, 4, 0},                                                                        \
+        {OUT_SOUND2, 0x10, 7, 0},                                                                        \
+    }
+
+const GameInfo games[NUM_GAMES] = {
+    [GAME_INVADERS] = {
+        .name = "Space Invaders",
+        .bank = "./sounds/invaders.bank",
+        INVADERS_PORTS,
+        INVADERS_KEYS,
+        INVADERS_SOUNDS,
+    },
+    // part II keeps the Space Invaders sound bits
+    [GAME_INVADERS_DX] = {
+        .name = "Space Invaders Part II",
+        .bank = "./sounds/invaders2.bank",
+        INVADERS_PORTS,
+        INVADERS_KEYS,
+        INVADERS_SOUNDS,
+    },
+    [GAME_LRESCUE] = {
+        .name = "Lunar Rescue",
+        .bank = "./sounds/lrescue.bank",
+        INVADERS_PORTS,
+        INVADERS_KEYS,
+        LRESCUE_SOUNDS,
+    },
+    [GAME_BALLOON] = {
+        .name = "Balloon Bomber",
+        .bank = "./sounds/balloon.bank",
+        INVADERS_PORTS,
+        INVADERS_KEYS,
+        BALLOON_SOUNDS,
+    },
+};
@@ -1,9 +1,11 @@
+#include <errno.h>
 #include <stdint.h>
 #include <time.h>
 
+#include "audio.h"
+#include "interrupts.h"
 #include "ports.h"
 #include "processor.h"
-#include "sounds.h"
 
 // function to generate interrupts
 void generate_interrupt(State8080 *state, int interrupt_num)
@@ -12,8 +14,8 @@ void generate_interrupt(State8080 *state, int interrupt_num)
     // perform "PUSH PC" - see the example for what this does.
     // Push(state, (state->pc & 0xFF00) >> 8, (state->pc & 0xff)); // this function doesn't exist yet.
 
-    state->memory[state->sp - 1] = (state->pc & 0xFF00) >> 8;
-    state->memory[state->sp - 2] = (state->pc & 0xff);
+    write_byte(state, state->sp - 1, (state->pc & 0xFF00) >> 8);
+    write_byte(state, state->sp - 2, (state->pc & 0xff));
     state->sp = state->sp - 2;
 
     // printf("stack pointer is now: %04x\n", state->sp);
@@ -48,132 +50,259 @@ double time_ms()
     return ((double)ts.tv_sec * 1e3) + ((double)ts.tv_nsec / 1e6);
 }
 
-// global to check how many interrupts - delete this later.
-int numInterrupts = 0;
-
-// some other recommended functions. see http://www.emulator101.com/cocoa-port-pt-2---machine-object.html
-void run_cpu(SpaceInvadersMachine *machine)
+// execute one instruction, handling IN/OUT through the machine's ports.
+// returns the number of cpu cycles used.
+int step_cpu(SpaceInvadersMachine *machine)
 {
-    // determine if interrupt should happen
-    double now = time_us();
-    if (machine->lastTimer == 0.0)
-    {
-        // set up initial values for timers
-        machine->lastTimer = now;
-        machine->nextInterrupt = machine->lastTimer + 16000.0;
-        machine->whichInterrupt = 1;
-    }
+    int cycles;
+    unsigned char *op;
+    op = &machine->state.memory[machine->state.pc];
 
-    if (machine->state->int_enable && (now > machine->nextInterrupt))
+    // handle IN
+    if (*op == 0xdb)
     {
-        if (machine->whichInterrupt == 1)
+        uint8_t port = op[1];
+        const PortTable *ports = machine->ports;
+
+        // set register A to the value of the port. the shift register
+        // is read without a call.
+        if (port == ports->shift_result)
         {
-            generate_interrupt(machine->state, 1);
-            numInterrupts += 1;
-            machine->whichInterrupt = 2;
+            machine->state.a = shift_result(machine);
         }
         else
         {
-            generate_interrupt(machine->state, 2);
-            numInterrupts += 1;
-            machine->whichInterrupt = 1;
+            machine->state.a = ports->in[port](machine, port);
         }
-        machine->nextInterrupt = now + 8000.0;
-    }
-
-    // run the emulation - seems like it gets stuck here when first starting
-    double sinceLast = now - machine->lastTimer;
+        machine->state.pc += 2;                       // update the program counter
+        cycles = 3;                                    // update cpu cycles
 
-    int cycles_to_catch_up = 2 * sinceLast;
-    int cycles = 0;
-
-    // run a certain number of cycles
-    // it seems to get stuck here.
-    while (cycles_to_catch_up > cycles)
+#ifdef DEBUG
+        printf("%x: handling input of %d\n", op[0], port);
+        printf("register a: %d\n", machine->state.a);
+#endif
+        // printf("press a key to continue.\n");
+        // getchar();
+    }
+    // handle OUT
+    else if (*op == 0xd3)
     {
-        unsigned char *op;
-        op = &machine->state->memory[machine->state->pc];
+        uint8_t port = machine->state.memory[machine->state.pc + 1];
+        const PortTable *ports = machine->ports;
 
-        // handle IN
-        if (*op == 0xdb)
+        // set the port to the value of register A. the shift register is
+        // written without a call, and can't change a sound.
+        if (port == ports->shift_data)
         {
-            uint8_t port = op[1];
-
-            machine->state->a = input_port(machine, port); // set register A to the value of the port.
-            machine->state->pc += 2;                       // update the program counter
-            cycles += 3;                                   // update cpu cycles
-
-#ifdef DEBUG
-            printf("%x: handling input of %d\n", op[0], port);
-            printf("register a: %d\n", machine->state->a);
-#endif
-            // printf("press a key to continue.\n");
-            // getchar();
+            shift_data(machine, machine->state.a);
         }
-        // handle OUT
-        else if (*op == 0xd3)
+        else if (port == ports->shift_offset)
         {
-            uint8_t port = machine->state->memory[machine->state->pc + 1];
-
-            output_port(machine, port, machine->state->a); // set the port to the value of register A.
-
-            play_sounds(machine);
-
-            machine->state->pc += 2; // update the program counter
-            cycles += 3;             // update cpu cycles
-#ifdef DEBUG
-            printf("handling output of %d\n", port);
-#endif
+            shift_offset(machine, machine->state.a);
         }
-
-        // perform normal emulation.
         else
         {
-#ifdef DEBUG
-            if (*op == 0x3a)
+            ports->out[port](machine, port, machine->state.a);
+
+            // only a machine with a mixer makes sound: the game, or the
+            // headless runner rendering a wav file
+            if (machine->sound.mixer != NULL)
             {
-                if (machine->state->memory[0x20c0] == 0)
-                {
-                    printf("LDA instruction and compare is 0\n");
-                    printf("memory is %04x\n", machine->state->memory[0x20c0]);
-                    // getchar();
-                }
+                play_sounds(machine);
             }
+        }
+
+        machine->state.pc += 2; // update the program counter
+        cycles = 3;              // update cpu cycles
+#ifdef DEBUG
+        printf("handling output of %d\n", port);
+#endif
+    }
 
-            if (*op == 0x35)
+    // perform normal emulation.
+    else
+    {
+#ifdef DEBUG
+        if (*op == 0x3a)
+        {
+            if (machine->state.memory[0x20c0] == 0)
             {
-                printf("DCR H\n");
-                printf("memory address is %02x %02x\n", machine->state->h, machine->state->l);
-                uint16_t offset = (uint16_t)machine->state->h << 8 | (uint16_t)machine->state->l;
-                printf("memory is now %d\n", machine->state->memory[offset]);
+                printf("LDA instruction and compare is 0\n");
+                printf("memory is %04x\n", machine->state.memory[0x20c0]);
                 // getchar();
             }
-#endif
+        }
 
-            // this should return the number of cycles per instruction.
-            // cpu.c should be updated to return the number of cycles
-            cycles += emulate_i8080(machine->state);
+        if (*op == 0x35)
+        {
+            printf("DCR H\n");
+            printf("memory address is %02x %02x\n", machine->state.h, machine->state.l);
+            uint16_t offset = (uint16_t)machine->state.h << 8 | (uint16_t)machine->state.l;
+            printf("memory is now %d\n", machine->state.memory[offset]);
+            // getchar();
         }
+#endif
+
+        // this should return the number of cycles per instruction.
+        // cpu.c should be updated to return the number of cycles
+        cycles = emulate_i8080(&machine->state);
+    }
+
+    return cycles;
+}
+
+// run exactly one frame of emulated time without looking at the wall clock.
+// the mid-screen interrupt (RST 1) fires halfway through the frame and the
+// vblank interrupt (RST 2) at the end, so the result only depends on the inputs.
+void run_frame(SpaceInvadersMachine *machine)
+{
+    // cycles left over from the previous frame count towards this one.
+    // frameCycles is kept current so machine_cycles() is right mid-frame.
+    while (machine->frameCycles < HALF_FRAME_CYCLES)
+    {
+        machine->frameCycles += step_cpu(machine);
+    }
+    if (machine->state.int_enable)
+    {
+        generate_interrupt(&machine->state, 1);
+        machine->numInterrupts += 1;
+    }
+
+    while (machine->frameCycles < FRAME_CYCLES)
+    {
+        machine->frameCycles += step_cpu(machine);
     }
-    // update the last timer value
-    machine->lastTimer = now;
+    if (machine->state.int_enable)
+    {
+        generate_interrupt(&machine->state, 2);
+        machine->numInterrupts += 1;
+    }
+
+    machine->frameCycles -= FRAME_CYCLES;
+    machine->frameStart += FRAME_CYCLES;
+}
+
+// fire the interrupt that is due at this point of the frame, if any, and
+// return its number. like run_frame, an interrupt that comes while the game
+// has interrupts disabled is lost.
+static int frame_interrupt(SpaceInvadersMachine *machine)
+{
+    int interrupt = 0;
+    if (machine->whichInterrupt == 1 && machine->frameCycles >= HALF_FRAME_CYCLES)
+    {
+        interrupt = 1;
+    }
+    else if (machine->whichInterrupt == 2 && machine->frameCycles >= FRAME_CYCLES)
+    {
+        interrupt = 2;
+        machine->frameCycles -= FRAME_CYCLES;
+        machine->frameStart += FRAME_CYCLES;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (machine->state.int_enable)
+    {
+        generate_interrupt(&machine->state, interrupt);
+        machine->numInterrupts += 1;
+    }
+    machine->whichInterrupt = interrupt == 1 ? 2 : 1;
+    return interrupt;
+}
+
+// run the cpu until the next interrupt is due, fire it and return its number.
+// two calls emulate the same frame as run_frame, without touching the clock,
+// so the caller decides how fast frames go by.
+int run_to_interrupt(SpaceInvadersMachine *machine)
+{
+    int interrupt = 0;
+    while (interrupt == 0)
+    {
+        machine->frameCycles += step_cpu(machine);
+        interrupt = frame_interrupt(machine);
+    }
+    return interrupt;
+}
+
+// sleep until the frame after *deadline is due, frame_ns later (FRAME_NS
+// unless something else sets the pace), and move *deadline on to it. the
+// deadlines are absolute, so a late wake-up is made up on the next frame
+// instead of adding up. if the thread fell more than MAX_FRAME_LAG frames
+// behind (a stall, or the machine was suspended), the lost time is dropped
+// rather than run flat out to catch up.
+void wait_frame(struct timespec *deadline, long long frame_ns)
+{
+    deadline->tv_nsec += frame_ns;
+    if (deadline->tv_nsec >= 1000000000)
+    {
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000000000;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long late = (now.tv_sec - deadline->tv_sec) * 1000000000LL + (now.tv_nsec - deadline->tv_nsec);
+    if (late > MAX_FRAME_LAG * FRAME_NS)
+    {
+        *deadline = now;
+        return;
+    }
+
+    // a signal can cut the sleep short, the deadline stays the same
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR)
+    {
+    }
+}
+
+// some other recommended functions. see http://www.emulator101.com/cocoa-port-pt-2---machine-object.html
+// run the cpu until it has caught up with the wall clock. the interrupts are
+// timed in emulated cycles, the same as run_frame, so every frame gets its
+// RST 1 and RST 2 however the thread is scheduled. returns straight after
+// an interrupt with its number, so the caller sees the machine as it was at
+// that moment, and 0 once the cpu has caught up.
+int run_cpu(SpaceInvadersMachine *machine)
+{
+    double now = time_us();
+    if (machine->lastTimer == 0.0)
+    {
+        // start the clock
+        machine->lastTimer = now;
+    }
+
+    int cycles_to_catch_up = (now - machine->lastTimer) * (CPU_CLOCK / 1e6);
+    int cycles = 0;
+    int interrupt = 0;
+    while (cycles < cycles_to_catch_up && interrupt == 0)
+    {
+        int used = step_cpu(machine);
+        cycles += used;
+        machine->frameCycles += used;
+        interrupt = frame_interrupt(machine);
+    }
+
+    // move the clock on by the time emulated, what is left is caught up
+    // on the next call
+    machine->lastTimer += cycles / (CPU_CLOCK / 1e6);
 #ifdef DEBUG
     printf("stopping emulation for this iteration\n");
 
     // check the machine state - it is delaying for 64 interrupts.
-    if (machine->state->memory[0x20c0] != 0)
+    if (machine->state.memory[0x20c0] != 0)
     {
-        printf("isrDelay value is still %04x\n", machine->state->memory[0x20c0]);
-        printf("the program counter is %04x\n", machine->state->pc);
+        printf("isrDelay value is still %04x\n", machine->state.memory[0x20c0]);
+        printf("the program counter is %04x\n", machine->state.pc);
     }
 
-    printf("num interrupts is %d\n", numInterrupts);
-    if (numInterrupts >= 64)
+    printf("num interrupts is %d\n", machine->numInterrupts);
+    if (machine->numInterrupts >= 64)
     {
-        numInterrupts = 0;
+        machine->numInterrupts = 0;
     }
 
     printf("cycles to catch up was: %d\n", cycles_to_catch_up);
 // getchar();
 #endif
+    return interrupt;
 }
\ No newline at end of file
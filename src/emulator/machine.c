@@ -0,0 +1,418 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "machine.h"
+
+// bytes at the start of SpaceInvadersMachine that are copied as they are
+#define MACHINE_FIELDS offsetof(SpaceInvadersMachine, pages)
+
+// a snapshot of a machine that wrote to at most this many pages since it
+// was last on a table keeps its own copies of them, on top of that table.
+// one of a machine that wrote to more moves the machine to a new table.
+#define SNAPSHOT_PAGES 8
+
+struct MachineSnapshot
+{
+    PageTable *pages;                // memory, apart from the pages below
+    int count;                       // pages the snapshot has its own copies of
+    uint8_t index[SNAPSHOT_PAGES];   // which memory page each one is
+    MemPage *page[SNAPSHOT_PAGES];   // the copies, one reference each
+    unsigned char fields[MACHINE_FIELDS];
+};
+
+// pages, groups, tables and snapshots freed by this thread, kept for the
+// next one made, so a search doesn't malloc each page of each snapshot
+typedef struct FreeBlock
+{
+    struct FreeBlock *next;
+} FreeBlock;
+
+static _Thread_local FreeBlock *free_pages, *free_groups, *free_tables, *free_snapshots;
+
+static void *block_get(FreeBlock **list, size_t size)
+{
+    FreeBlock *block = *list;
+    if (block == NULL)
+    {
+        return malloc(size);
+    }
+    *list = block->next;
+    return block;
+}
+
+static void block_put(FreeBlock **list, void *block)
+{
+    FreeBlock *free_block = block;
+    free_block->next = *list;
+    *list = free_block;
+}
+
+static void page_release(MemPage *page)
+{
+    if (page != &zero_page && --page->refs == 0)
+    {
+        block_put(&free_pages, page);
+    }
+}
+
+static void group_hold(PageGroup *group)
+{
+    if (group->refs > 0)
+    {
+        group->refs++;
+    }
+}
+
+static void group_release(PageGroup *group)
+{
+    // the zero group has no references
+    if (group->refs > 0 && --group->refs == 0)
+    {
+        for (int i = 0; i < GROUP_PAGES; i++)
+        {
+            page_release(group->page[i]);
+        }
+        block_put(&free_groups, group);
+    }
+}
+
+static void table_hold(PageTable *table)
+{
+    if (table != &zero_table)
+    {
+        table->refs++;
+    }
+}
+
+static void table_release(PageTable *table)
+{
+    if (table != &zero_table && --table->refs == 0)
+    {
+        for (int i = 0; i < NUM_GROUPS; i++)
+        {
+            group_release(table->group[i]);
+        }
+        block_put(&free_tables, table);
+    }
+}
+
+SpaceInvadersMachine *machine_create(void)
+{
+    // sizeof is already a multiple of CACHE_LINE because of the aligned memory member
+    SpaceInvadersMachine *machine = aligned_alloc(CACHE_LINE, sizeof(SpaceInvadersMachine));
+    if (machine == NULL)
+    {
+        return NULL;
+    }
+    memset(machine, 0, sizeof(SpaceInvadersMachine));
+    // zeroed memory is exactly the zero table
+    machine->pages = &zero_table;
+    machine_reset(machine);
+    return machine;
+}
+
+void machine_reset(SpaceInvadersMachine *machine)
+{
+    // clear the CPU state and point it at this machine's memory. the memory
+    // hash belongs to the memory, which is only partly cleared below.
+    uint64_t mem_hash = machine->state.mem_hash;
+    memset(&machine->state, 0, sizeof(State8080));
+    machine->state.memory = machine->memory;
+    machine->state.dirty = machine->dirty;
+    machine->state.dirty_lines = machine->dirty_lines;
+    machine->state.mem_hash = mem_hash;
+
+    // timers - lastTimer of 0 makes run_cpu start the interrupt clock right away
+    machine->lastTimer = 0;
+    machine->whichInterrupt = 1;
+    machine->numInterrupts = 0;
+    machine->frameCycles = 0;
+    machine->frameStart = 0;
+
+    // port latches
+    machine->in_port = 0x00;
+    machine->in_port_2 = 0x00;
+    machine->out_port = 0x00;
+    machine->shift0 = 0;
+    machine->shift1 = 0;
+    machine->shift_offset = 0;
+    machine->out_port_3 = 0;
+    machine->out_port_5 = 0;
+    machine->prev_out_port_3 = 0;
+    machine->prev_out_port_5 = 0;
+    machine->keys_applied = 0;
+
+    // clear work RAM and video RAM, ROM images stay loaded
+    mem_clear(machine, RAM_START, RAM_END);
+}
+
+uint64_t machine_hash(const SpaceInvadersMachine *machine)
+{
+    const State8080 *state = &machine->state;
+    uint64_t flags = state->cc.z | state->cc.s << 1 | state->cc.p << 2 | state->cc.cy << 3 | state->cc.ac << 4;
+    uint64_t regs = (uint64_t)state->a | (uint64_t)state->b << 8 | (uint64_t)state->c << 16 |
+                    (uint64_t)state->d << 24 | (uint64_t)state->e << 32 | (uint64_t)state->h << 40 |
+                    (uint64_t)state->l << 48 | flags << 56;
+    uint64_t control = (uint64_t)state->sp | (uint64_t)state->pc << 16 | (uint64_t)state->int_enable << 32 |
+                       (uint64_t)(machine->whichInterrupt & 0xff) << 40 | (uint64_t)machine->in_port << 48 |
+                       (uint64_t)machine->in_port_2 << 56;
+    uint64_t ports = (uint64_t)machine->out_port | (uint64_t)machine->shift0 << 8 |
+                     (uint64_t)machine->shift1 << 16 | (uint64_t)machine->shift_offset << 24 |
+                     (uint64_t)machine->out_port_3 << 32 | (uint64_t)machine->out_port_5 << 40 |
+                     (uint64_t)machine->prev_out_port_3 << 48 | (uint64_t)machine->prev_out_port_5 << 56;
+
+    uint64_t hash = state->mem_hash;
+    hash = hash_mix(hash ^ regs);
+    hash = hash_mix(hash ^ control);
+    hash = hash_mix(hash ^ ports);
+    // where the machine is in the frame decides when the next interrupt hits
+    hash = hash_mix(hash ^ (uint32_t)machine->frameCycles);
+    return hash;
+}
+
+// first dirty page at or after i, NUM_PAGES if there is none. most pages
+// are clean, so the flags are read 8 at a time (little endian: the lowest
+// byte of a word is the first page).
+static int next_dirty(const uint8_t *dirty, int i)
+{
+    while (i < NUM_PAGES)
+    {
+        int first = i & ~7;
+        uint64_t word;
+        memcpy(&word, dirty + first, sizeof(word));
+        word &= ~0ULL << ((i & 7) * 8);
+        if (word != 0)
+        {
+            return first + __builtin_ctzll(word) / 8;
+        }
+        i = first + 8;
+    }
+    return NUM_PAGES;
+}
+
+// whether any page of group g was written to
+static int group_dirty(const uint8_t *dirty, int g)
+{
+    uint64_t any = 0;
+    for (int i = g << GROUP_SHIFT; i < (g + 1) << GROUP_SHIFT; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, dirty + i, sizeof(word));
+        any |= word;
+    }
+    return any != 0;
+}
+
+// a new group of group's pages, with the dirty ones copied from memory.
+// NULL if out of memory.
+static PageGroup *group_update(const PageGroup *group, const uint8_t *memory, const uint8_t *dirty)
+{
+    PageGroup *update = block_get(&free_groups, sizeof(PageGroup));
+    if (update == NULL)
+    {
+        return NULL;
+    }
+    update->refs = 1;
+    for (int i = 0; i < GROUP_PAGES; i++)
+    {
+        MemPage *page = group->page[i];
+        if (dirty[i])
+        {
+            page = block_get(&free_pages, sizeof(MemPage));
+            if (page == NULL)
+            {
+                // the rest of the group is left empty to release it
+                for (; i < GROUP_PAGES; i++)
+                {
+                    update->page[i] = &zero_page;
+                }
+                group_release(update);
+                return NULL;
+            }
+            page->refs = 0;
+            memcpy(page->data, memory + (i << PAGE_SHIFT), PAGE_SIZE);
+        }
+        if (page != &zero_page)
+        {
+            page->refs++;
+        }
+        update->page[i] = page;
+    }
+    return update;
+}
+
+MachineSnapshot *machine_snapshot(SpaceInvadersMachine *machine)
+{
+    MachineSnapshot *snapshot = block_get(&free_snapshots, sizeof(MachineSnapshot));
+    if (snapshot == NULL)
+    {
+        return NULL;
+    }
+    memcpy(snapshot->fields, machine, MACHINE_FIELDS);
+
+    // a few pages written since the machine was last on a table (the usual
+    // case for a frame or two of a game): copy them and share the table.
+    // the machine stays on the table, with the pages still dirty.
+    int count = 0;
+    for (int i = next_dirty(machine->dirty, 0); i < NUM_PAGES && count <= SNAPSHOT_PAGES;
+         i = next_dirty(machine->dirty, i + 1))
+    {
+        if (count < SNAPSHOT_PAGES)
+        {
+            snapshot->index[count] = i;
+        }
+        count++;
+    }
+    if (count <= SNAPSHOT_PAGES)
+    {
+        for (int n = 0; n < count; n++)
+        {
+            MemPage *page = block_get(&free_pages, sizeof(MemPage));
+            if (page == NULL)
+            {
+                while (n-- > 0)
+                {
+                    page_release(snapshot->page[n]);
+                }
+                block_put(&free_snapshots, snapshot);
+                return NULL;
+            }
+            page->refs = 1;
+            memcpy(page->data, machine->memory + (snapshot->index[n] << PAGE_SHIFT), PAGE_SIZE);
+            snapshot->page[n] = page;
+        }
+        snapshot->count = count;
+        table_hold(machine->pages);
+        snapshot->pages = machine->pages;
+        return snapshot;
+    }
+
+    // a new table with new groups where pages were written to, sharing
+    // the other groups. the machine is only changed once it is complete.
+    PageTable *table = block_get(&free_tables, sizeof(PageTable));
+    if (table == NULL)
+    {
+        block_put(&free_snapshots, snapshot);
+        return NULL;
+    }
+    table->refs = 1;
+    for (int g = 0; g < NUM_GROUPS; g++)
+    {
+        PageGroup *group = machine->pages->group[g];
+        if (group_dirty(machine->dirty, g))
+        {
+            int first = g << GROUP_SHIFT;
+            group = group_update(group, machine->memory + (first << PAGE_SHIFT), machine->dirty + first);
+            if (group == NULL)
+            {
+                for (; g < NUM_GROUPS; g++)
+                {
+                    table->group[g] = zero_table.group[g];
+                }
+                table_release(table);
+                block_put(&free_snapshots, snapshot);
+                return NULL;
+            }
+        }
+        else
+        {
+            group_hold(group);
+        }
+        table->group[g] = group;
+    }
+
+    table_release(machine->pages);
+    machine->pages = table;
+    memset(machine->dirty, 0, NUM_PAGES);
+    table_hold(table);
+    snapshot->count = 0;
+    snapshot->pages = table;
+    return snapshot;
+}
+
+// copy page i of the snapshot back into memory
+static void restore_page(SpaceInvadersMachine *machine, const MemPage *page, int i)
+{
+    memcpy(machine->memory + (i << PAGE_SHIFT), page->data, PAGE_SIZE);
+    memset(machine->dirty_lines + (i << PAGE_SHIFT >> LINE_SHIFT), 1, PAGE_SIZE >> LINE_SHIFT);
+}
+
+// the table's page i, unless the page is one of the snapshot's own (2),
+// which stays dirty
+static void restore_table_page(SpaceInvadersMachine *machine, const MemPage *page, int i)
+{
+    if (machine->dirty[i] == 2)
+    {
+        machine->dirty[i] = 1;
+        return;
+    }
+    restore_page(machine, page, i);
+    machine->dirty[i] = 0;
+}
+
+void machine_restore(SpaceInvadersMachine *machine, const MachineSnapshot *snapshot)
+{
+    memcpy(machine, snapshot->fields, MACHINE_FIELDS);
+    machine->state.memory = machine->memory;
+    machine->state.dirty = machine->dirty;
+    machine->state.dirty_lines = machine->dirty_lines;
+
+    // the snapshot's own pages first, they differ from its table
+    for (int n = 0; n < snapshot->count; n++)
+    {
+        restore_page(machine, snapshot->page[n], snapshot->index[n]);
+        machine->dirty[snapshot->index[n]] = 2;
+    }
+
+    PageTable *from = machine->pages;
+    PageTable *to = snapshot->pages;
+    if (from == to)
+    {
+        // back to the table the machine came from (the usual case in a
+        // search), only the pages written since then differ
+        for (int i = next_dirty(machine->dirty, 0); i < NUM_PAGES; i = next_dirty(machine->dirty, i + 1))
+        {
+            restore_table_page(machine, table_page(to, i), i);
+        }
+        return;
+    }
+
+    // groups the two tables share only differ in their dirty pages
+    for (int g = 0; g < NUM_GROUPS; g++)
+    {
+        const PageGroup *a = from->group[g];
+        const PageGroup *b = to->group[g];
+        if (a == b && !group_dirty(machine->dirty, g))
+        {
+            continue;
+        }
+        for (int i = 0; i < GROUP_PAGES; i++)
+        {
+            int page = (g << GROUP_SHIFT) + i;
+            if (a->page[i] != b->page[i] || machine->dirty[page])
+            {
+                restore_table_page(machine, b->page[i], page);
+            }
+        }
+    }
+    table_hold(to);
+    table_release(from);
+    machine->pages = to;
+}
+
+void snapshot_destroy(MachineSnapshot *snapshot)
+{
+    for (int n = 0; n < snapshot->count; n++)
+    {
+        page_release(snapshot->page[n]);
+    }
+    table_release(snapshot->pages);
+    block_put(&free_snapshots, snapshot);
+}
+
+void machine_destroy(SpaceInvadersMachine *machine)
+{
+    table_release(machine->pages);
+    free(machine);
+}
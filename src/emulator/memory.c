@@ -1,127 +1,218 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <memory.h>
 
-// 16K buffer (sufficient for Space Invaders)
-// increase mem size for other games
-#define MEM_SIZE 0x4FFF
+#include "machine.h"
+#include "memory.h"
+#include "ports.h"
 
-// global memory buffer
-// instructions/operands are unsigned chars
-unsigned char memory[MEM_SIZE];
+MemPage zero_page;
+static PageGroup zero_group = {0, {[0 ... GROUP_PAGES - 1] = &zero_page}};
+PageTable zero_table = {0, {[0 ... NUM_GROUPS - 1] = &zero_group}};
 
-void load_file(char *file, int address)
+// XOR of the keys of memory[start..end)
+static uint64_t hash_range(const uint8_t *memory, int start, int end)
+{
+    uint64_t hash = 0;
+    for (int i = start; i < end; i++)
+    {
+        hash ^= mem_key(i, memory[i]);
+    }
+    return hash;
+}
+
+int load_file(SpaceInvadersMachine *machine, char *file, int address)
 {
     FILE *f = fopen(file, "rb");
     if (f == NULL)
     {
-        printf("error: Couldn't open %s\n", file);
-        exit(1);
+        fprintf(stderr, "error: Couldn't open %s\n", file);
+        return -1;
     }
     // get file size
     fseek(f, 0L, SEEK_END);
     int fsize = ftell(f);
     fseek(f, 0L, SEEK_SET);
 
+    // don't read past the end of the address space
+    if (address + fsize > MEM_SIZE)
+    {
+        fsize = MEM_SIZE - address;
+    }
+
     // read bytes into memory
-    fread(memory + address, 1, fsize, f);
+    machine->state.mem_hash ^= hash_range(machine->memory, address, address + fsize);
+    fread(machine->memory + address, 1, fsize, f);
     fclose(f);
+    machine->state.mem_hash ^= hash_range(machine->memory, address, address + fsize);
+
+    // the pages no longer match the last snapshot
+    for (int i = address >> PAGE_SHIFT; i <= (address + fsize - 1) >> PAGE_SHIFT; i++)
+    {
+        machine->dirty[i] = 1;
+    }
+    // and the screen may have changed
+    for (int i = address >> LINE_SHIFT; i <= (address + fsize - 1) >> LINE_SHIFT; i++)
+    {
+        machine->dirty_lines[i] = 1;
+    }
+    return 0;
 }
 
-unsigned char mem_read(int address)
+unsigned char mem_read(SpaceInvadersMachine *machine, int address)
 {
     // read one byte from memory
-    return memory[address];
+    return machine->memory[address];
 }
 
-void mem_write(int address, unsigned char byte)
+void mem_write(SpaceInvadersMachine *machine, int address, unsigned char byte)
 {
     // write one byte to memory
     // first 2K bytes are read-only memory
     if (address < 0x800)
     {
-        printf("error: Can't write to ROM at address %x\n", address);
+        fprintf(stderr, "error: Can't write to ROM at address %x\n", address);
     }
     else
     {
         // set address to byte
-        memory[address] = byte;
+        write_byte(&machine->state, address, byte);
     }
 }
 
-void mem_init()
+int mem_init(SpaceInvadersMachine *machine)
 {
+    port_select(machine, GAME_INVADERS);
+
     // initialize memory
     // clear memory buffer (set all bytes to 0)
-    memset(memory, 0, MEM_SIZE);
+    mem_clear(machine, 0, MEM_SIZE);
 
     // load game files (each one is 2048 (or 0x800) bytes)
     // start from RAM address
-    load_file("./roms/invaders.h", 0x0000);
-    load_file("./roms/invaders.g", 0x0800);
-    load_file("./roms/invaders.f", 0x1000);
-    load_file("./roms/invaders.e", 0x1800);
+    if (load_file(machine, "./roms/invaders.h", 0x0000) < 0 ||
+        load_file(machine, "./roms/invaders.g", 0x0800) < 0 ||
+        load_file(machine, "./roms/invaders.f", 0x1000) < 0 ||
+        load_file(machine, "./roms/invaders.e", 0x1800) < 0)
+    {
+        return -1;
+    }
+    return 0;
 }
 
-void mem_init_balloon()
+int mem_init_balloon(SpaceInvadersMachine *machine)
 {
+    port_select(machine, GAME_BALLOON);
+
     // initialize memory
     // clear memory buffer (set all bytes to 0)
-    memset(memory, 0, MEM_SIZE);
+    mem_clear(machine, 0, MEM_SIZE);
 
     // balloon bomber
-    load_file("./roms/tn01", 0x0000);
-    load_file("./roms/tn02", 0x0800);
-    load_file("./roms/tn03", 0x1000);
-    load_file("./roms/tn04", 0x1800);
-    load_file("./roms/tn05-1", 0x4000);
+    if (load_file(machine, "./roms/tn01", 0x0000) < 0 ||
+        load_file(machine, "./roms/tn02", 0x0800) < 0 ||
+        load_file(machine, "./roms/tn03", 0x1000) < 0 ||
+        load_file(machine, "./roms/tn04", 0x1800) < 0 ||
+        load_file(machine, "./roms/tn05-1", 0x4000) < 0)
+    {
+        return -1;
+    }
+    return 0;
 }
 
 
-void mem_init_lrescue()
+int mem_init_lrescue(SpaceInvadersMachine *machine)
 {
+    port_select(machine, GAME_LRESCUE);
+
     // initialize memory
     // clear memory buffer (set all bytes to 0)
-    memset(memory, 0, MEM_SIZE);
+    mem_clear(machine, 0, MEM_SIZE);
 
     // lunar rescue
-    load_file("./roms/lrescue.1", 0x0000);
-    load_file("./roms/lrescue.2", 0x0800);
-    load_file("./roms/lrescue.3", 0x1000);
-    load_file("./roms/lrescue.4", 0x1800);
-    load_file("./roms/lrescue.5", 0x4000);
-    load_file("./roms/lrescue.6", 0x4800);
+    if (load_file(machine, "./roms/lrescue.1", 0x0000) < 0 ||
+        load_file(machine, "./roms/lrescue.2", 0x0800) < 0 ||
+        load_file(machine, "./roms/lrescue.3", 0x1000) < 0 ||
+        load_file(machine, "./roms/lrescue.4", 0x1800) < 0 ||
+        load_file(machine, "./roms/lrescue.5", 0x4000) < 0 ||
+        load_file(machine, "./roms/lrescue.6", 0x4800) < 0)
+    {
+        return -1;
+    }
+    return 0;
 }
 
-void mem_init_dx()
+int mem_init_dx(SpaceInvadersMachine *machine)
 {
+    port_select(machine, GAME_INVADERS_DX);
+
     // initialize memory
     // clear memory buffer (set all bytes to 0)
-    memset(memory, 0, MEM_SIZE);
+    mem_clear(machine, 0, MEM_SIZE);
 
     // load game files (each one is 2048 (or 0x800) bytes)
     // start from RAM address
     // space invaders deluxe
-    load_file("./roms/invdelux.h", 0x0000);
-    load_file("./roms/invdelux.g", 0x0800);
-    load_file("./roms/invdelux.f", 0x1000);
-    load_file("./roms/invdelux.e", 0x1800);
-    load_file("./roms/invdelux.d", 0x4000);
+    if (load_file(machine, "./roms/invdelux.h", 0x0000) < 0 ||
+        load_file(machine, "./roms/invdelux.g", 0x0800) < 0 ||
+        load_file(machine, "./roms/invdelux.f", 0x1000) < 0 ||
+        load_file(machine, "./roms/invdelux.e", 0x1800) < 0 ||
+        load_file(machine, "./roms/invdelux.d", 0x4000) < 0)
+    {
+        return -1;
+    }
+    return 0;
 
 }
 
-void print_memory()
+// load the ROM images for one of the games enum
+int mem_init_game(SpaceInvadersMachine *machine, int game)
+{
+    switch (game)
+    {
+    case GAME_INVADERS:
+        return mem_init(machine);
+    case GAME_INVADERS_DX:
+        return mem_init_dx(machine);
+    case GAME_LRESCUE:
+        return mem_init_lrescue(machine);
+    case GAME_BALLOON:
+        return mem_init_balloon(machine);
+    }
+    fprintf(stderr, "error: unknown game %d\n", game);
+    return -1;
+}
+
+// zero the memory from start up to end (both multiples of PAGE_SIZE).
+// cleared pages that were zero at the last snapshot stay clean, so they
+// cost nothing to snapshot.
+void mem_clear(SpaceInvadersMachine *machine, int start, int end)
+{
+    machine->state.mem_hash ^= hash_range(machine->memory, start, end);
+    memset(machine->memory + start, 0, end - start);
+    memset(machine->dirty_lines + (start >> LINE_SHIFT), 1, (end - start) >> LINE_SHIFT);
+    for (int i = start >> PAGE_SHIFT; i < end >> PAGE_SHIFT; i++)
+    {
+        machine->dirty[i] = table_page(machine->pages, i) != &zero_page;
+    }
+}
+
+uint64_t mem_hash(SpaceInvadersMachine *machine)
+{
+    return hash_range(machine->memory, 0, MEM_SIZE);
+}
+
+void print_memory(SpaceInvadersMachine *machine)
 {
     // starting from RAM
     for (int i = 0; i < MEM_SIZE; ++i)
     {
         // pad hex values for clearer output
-        printf("%02x ", memory[i]);
+        printf("%02x ", machine->memory[i]);
         // newline every 16 bytes
         if ((i + 1) % 16 == 0)
         {
             printf("\n");
         }
     }
-}
\ No newline at end of file
+}
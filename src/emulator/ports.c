@@ -1,53 +1,172 @@
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdio.h>
 
-#include "processor.h"
-#include "controls.h"
+#include "games.h"
+#include "ports.h"
 
-// function to handle input port. this should put the value of the port into register A.
-// to run in attract mode, we need to return 1 from IN 0 and zero from IN 1.
-// external shift is IN 3, OUT 2, OUT 4.
-uint8_t input_port(SpaceInvadersMachine *machine, uint8_t port)
+static PortTable port_tables[NUM_GAMES];
+static pthread_once_t port_tables_once = PTHREAD_ONCE_INIT;
+
+// ports a game used without a handler, bit 0 for IN and bit 1 for OUT, so
+// each is reported only the first time
+static atomic_uchar unknown_ports[NUM_GAMES][256];
+
+static void report_unknown(SpaceInvadersMachine *machine, uint8_t port, int out)
 {
-    unsigned char a;
-    switch (port)
+    uint8_t bit = out ? 2 : 1;
+    if (!(atomic_fetch_or(&unknown_ports[machine->game][port], bit) & bit))
     {
-    case 0:                   // INPUTS (not used)
-        return 1;             // this will change if we handle input later. this may not do anything
-    case 1:                   // INPUTS
-        a = machine->in_port; // set register A to the value of in_port
-        break;
-    case 2:                     // INPUTS - set register A to value of in_port_2
-        a = machine->in_port_2; // change this later
-        break;
-    case 3: // this handles shift register. the result will be sent to register A.
+        // stdout may be the headless runner's video
+        fprintf(stderr, "%s: %s port %d is not handled, %s\n", games[machine->game].name, out ? "OUT" : "IN",
+                port, out ? "ignoring writes" : "reading 0");
+    }
+}
+
+static uint8_t in_none(SpaceInvadersMachine *machine, uint8_t port)
+{
+    report_unknown(machine, port, 0);
+    return 0;
+}
+
+// to run in attract mode, IN 0 has to return 1
+static uint8_t in_fixed(SpaceInvadersMachine *machine, uint8_t port)
+{
+    return games[machine->game].fixed;
+}
+
+// the player inputs take in the keys held right now, if another thread
+// reads the keyboard, and tell the machine's input hook
+static uint8_t in_player1(SpaceInvadersMachine *machine, uint8_t port)
+{
+    if (machine->keys != NULL)
     {
-        uint16_t v = (machine->shift1 << 8) | machine->shift0;
-        a = ((v >> (8 - machine->shift_offset)) & 0xff);
-        break;
+        keys_sample(machine);
     }
+    if (machine->input_hook != NULL)
+    {
+        machine->input_hook(machine, port, machine->input_hook_data);
     }
-    return a;
+    return machine->in_port;
 }
 
-// function to handle output port
-void output_port(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
+static uint8_t in_player2(SpaceInvadersMachine *machine, uint8_t port)
+{
+    if (machine->keys != NULL)
+    {
+        keys_sample(machine);
+    }
+    if (machine->input_hook != NULL)
+    {
+        machine->input_hook(machine, port, machine->input_hook_data);
+    }
+    return machine->in_port_2;
+}
+
+static uint8_t in_shift(SpaceInvadersMachine *machine, uint8_t port)
+{
+    return shift_result(machine);
+}
+
+// by enum port_inputs
+static const InputFn input_fn[NUM_PORT_INPUTS] = {
+    [IN_NONE] = in_none,
+    [IN_FIXED] = in_fixed,
+    [IN_PLAYER1] = in_player1,
+    [IN_PLAYER2] = in_player2,
+    [IN_SHIFT] = in_shift,
+};
+
+static void out_none(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
+{
+    report_unknown(machine, port, 1);
+}
+
+// the watchdog never bites
+static void out_watchdog(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
+{
+}
+
+static void out_shift_offset(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
+{
+    shift_offset(machine, value);
+}
+
+static void out_shift_data(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
+{
+    shift_data(machine, value);
+}
+
+static void out_sound1(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
 {
-    switch (port)
+    machine->out_port_3 = value;
+}
+
+static void out_sound2(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
+{
+    machine->out_port_5 = value;
+}
+
+// by enum port_outputs
+static const OutputFn output_fn[NUM_PORT_OUTPUTS] = {
+    [OUT_NONE] = out_none,
+    [OUT_SHIFT_OFFSET] = out_shift_offset,
+    [OUT_SHIFT_DATA] = out_shift_data,
+    [OUT_SOUND1] = out_sound1,
+    [OUT_SOUND2] = out_sound2,
+    [OUT_WATCHDOG] = out_watchdog,
+};
+
+// register every game's handlers from its port maps
+static void build_port_tables(void)
+{
+    for (int game = 0; game < NUM_GAMES; game++)
     {
-    case 2:
-        machine->shift_offset = value & 0x7;
-        break;
-    case 3: // sound bits
-        machine->out_port_3 = value;
-        break;
-    case 4:
-        machine->shift0 = machine->shift1;
-        machine->shift1 = value;
-        break;
-    case 5: // sound bits
-        machine->out_port_5 = value;
-        break;
-    case 6: // watchdog
-        break;
+        PortTable *table = &port_tables[game];
+        table->shift_result = table->shift_data = table->shift_offset = -1;
+        for (int port = 0; port < 256; port++)
+        {
+            uint8_t in = games[game].in[port];
+            uint8_t out = games[game].out[port];
+            table->in[port] = input_fn[in];
+            table->out[port] = output_fn[out];
+            if (in == IN_SHIFT)
+            {
+                table->shift_result = port;
+            }
+            if (out == OUT_SHIFT_DATA)
+            {
+                table->shift_data = port;
+            }
+            else if (out == OUT_SHIFT_OFFSET)
+            {
+                table->shift_offset = port;
+            }
+        }
     }
-}
\ No newline at end of file
+}
+
+const PortTable *port_table(int game)
+{
+    pthread_once(&port_tables_once, build_port_tables);
+    return &port_tables[game];
+}
+
+void port_select(SpaceInvadersMachine *machine, int game)
+{
+    machine->game = game;
+    machine->ports = port_table(game);
+}
+
+// function to handle input port. the result goes into register A.
+uint8_t input_port(SpaceInvadersMachine *machine, uint8_t port)
+{
+    return machine->ports->in[port](machine, port);
+}
+
+// function to handle output port
+void output_port(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
+{
+    machine->ports->out[port](machine, port, value);
+}
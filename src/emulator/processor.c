@@ -8,7 +8,7 @@
 // if the instruction is not implemented yet
 void unimplemented_instruction(State8080 *state)
 {
-    printf("error: unimplemented instruction %x\n", state->memory[state->pc]);
+    fprintf(stderr, "error: unimplemented instruction %x\n", state->memory[state->pc]);
     exit(1);
 }
 
@@ -18,21 +18,12 @@ void redirect_output(uint8_t byte, uint8_t port)
     printf("Output to port %d: %02X\n", port, byte);
 }
 
-// determines parity of a number
+// determines parity of a number (1 for even parity)
+// this runs for almost every ALU instruction, so use the compiler's parity builtin
 int parity(int x, int size)
 {
-    int i;
-    int p = 0;
     x = (x & ((1 << size) - 1));
-    for (i = 0; i < size; i++)
-    {
-        if (x & 0x1)
-        {
-            p++;
-        }
-        x = x >> 1;
-    }
-    return (0 == (p & 0x1));
+    return !__builtin_parity(x);
 }
 
 // sets flags after logical instruction on A register
@@ -93,7 +84,7 @@ int emulate_i8080(State8080 *state)
         // TODO - check if condition
         if (offset >= 0x800 && offset < 0x4000)
         {
-            state->memory[offset] = state->a;
+            write_byte(state, offset, state->a);
         }
         state->pc += 1;
         cycles = 7;
@@ -260,7 +251,7 @@ int emulate_i8080(State8080 *state)
         uint16_t offset = (uint16_t)state->d << 8 | (uint16_t)state->e; // for the memory location of register pair DE
         if (offset > 0x2000 && offset <= 0x4000)
         {
-            state->memory[offset] = state->a;
+            write_byte(state, offset, state->a);
         }
 
         state->pc += 1;
@@ -437,8 +428,8 @@ int emulate_i8080(State8080 *state)
         // should protect the memory?
         if (offset > 0x2000 && offset <= 0x4000)
         {
-            state->memory[offset] = state->l;
-            state->memory[offset + 1] = state->h;
+            write_byte(state, offset, state->l);
+            write_byte(state, offset + 1, state->h);
         }
 
         state->pc += 3;
@@ -615,7 +606,7 @@ int emulate_i8080(State8080 *state)
     case 0x32: // STA addr : (addr) <- A (store A into memory location addr or bytes 2 and 3)
     {
         uint16_t offset = (opcode[2] << 8 | opcode[1]);
-        state->memory[offset] = state->a;
+        write_byte(state, offset, state->a);
         state->pc += 3;
         cycles = 13;
         break;
@@ -637,7 +628,7 @@ int emulate_i8080(State8080 *state)
         uint16_t value = state->memory[offset];
         uint16_t answer = value + 1;
         // set the memory value to the answer
-        state->memory[offset] = answer;
+        write_byte(state, offset, answer);
 
         state->cc.z = ((answer & 0xff) == 0);
         state->cc.s = ((answer & 0x80) != 0);
@@ -658,7 +649,7 @@ int emulate_i8080(State8080 *state)
         // printf("memory before is %d\n", value);
         uint16_t answer = value - 1;
         // set the memory value to the answer
-        state->memory[offset] = answer;
+        write_byte(state, offset, answer);
         // printf("memory after is %d\n", state->memory[offset]);
         //  getchar();
 
@@ -675,7 +666,7 @@ int emulate_i8080(State8080 *state)
     case 0x36: // MVI M, D8 : (HL) <- byte 2 (move byte 2 to the memory location in (HL))
     {
         uint16_t offset = (uint16_t)state->h << 8 | (uint16_t)state->l;
-        state->memory[offset] = opcode[1];
+        write_byte(state, offset, opcode[1]);
         state->pc += 2;
         cycles = 10;
         break;
@@ -1161,7 +1152,7 @@ int emulate_i8080(State8080 *state)
 
         if (offset > 0x2000 && offset <= 0x4000)
         {
-            state->memory[offset] = state->b;
+            write_byte(state, offset, state->b);
         }
         state->pc += 1;
         cycles = 7;
@@ -1173,7 +1164,7 @@ int emulate_i8080(State8080 *state)
         uint16_t offset = (uint16_t)state->h << 8 | (uint16_t)state->l;
         if (offset > 0x2000 && offset <= 0x4000)
         {
-            state->memory[offset] = state->c;
+            write_byte(state, offset, state->c);
         }
         state->pc += 1;
         cycles = 7;
@@ -1186,7 +1177,7 @@ int emulate_i8080(State8080 *state)
 
         if (offset > 0x2000 && offset <= 0x4000)
         {
-            state->memory[offset] = state->d;
+            write_byte(state, offset, state->d);
         }
         state->pc += 1;
         cycles = 7;
@@ -1198,7 +1189,7 @@ int emulate_i8080(State8080 *state)
         uint16_t offset = (uint16_t)state->h << 8 | (uint16_t)state->l;
         if (offset > 0x2000 && offset <= 0x4000)
         {
-            state->memory[offset] = state->e;
+            write_byte(state, offset, state->e);
         }
 
         state->pc += 1;
@@ -1211,7 +1202,7 @@ int emulate_i8080(State8080 *state)
         uint16_t offset = (uint16_t)state->h << 8 | (uint16_t)state->l;
         if (offset > 0x2000 && offset <= 0x4000)
         {
-            state->memory[offset] = state->h;
+            write_byte(state, offset, state->h);
         }
         state->pc += 1;
         cycles = 7;
@@ -1223,7 +1214,7 @@ int emulate_i8080(State8080 *state)
         uint16_t offset = (uint16_t)state->h << 8 | (uint16_t)state->l;
         if (offset > 0x2000 && offset <= 0x4000)
         {
-            state->memory[offset] = state->l;
+            write_byte(state, offset, state->l);
         }
         state->pc += 1;
         cycles = 7;
@@ -1243,7 +1234,7 @@ int emulate_i8080(State8080 *state)
         // change this to use a protected write function for any opcode that writes to memory
         if (offset > 0x2000 && offset <= 0x4000)
         {
-            state->memory[offset] = state->a;
+            write_byte(state, offset, state->a);
         }
 
         state->pc += 1;
@@ -2135,8 +2126,8 @@ int emulate_i8080(State8080 *state)
             // call addr
             uint16_t ret = state->pc + 3; // address to return to after the CALL
             // push return address onto the stack
-            state->memory[state->sp - 1] = (ret >> 8) & 0xFF;
-            state->memory[state->sp - 2] = ret & 0xFF;
+            write_byte(state, state->sp - 1, (ret >> 8) & 0xFF);
+            write_byte(state, state->sp - 2, ret & 0xFF);
             state->sp = state->sp - 2;
             // jump to address specified in the CALL instruction
             uint16_t target = (state->memory[state->pc + 2] << 8) | state->memory[state->pc + 1];
@@ -2153,9 +2144,9 @@ int emulate_i8080(State8080 *state)
 
     case 0xc5: // PUSH B
         // Push B register onto the stack
-        state->memory[state->sp - 1] = state->b;
+        write_byte(state, state->sp - 1, state->b);
         // Push C register onto the stack
-        state->memory[state->sp - 2] = state->c;
+        write_byte(state, state->sp - 2, state->c);
         state->sp -= 2;
         state->pc++;
         cycles = 11;
@@ -2178,8 +2169,8 @@ int emulate_i8080(State8080 *state)
     {
         // Save the current PC on the stack before jumping
         uint16_t ret = state->pc + 1;
-        state->memory[state->sp - 1] = (ret >> 8) & 0xff; // high part of PC
-        state->memory[state->sp - 2] = (ret & 0xff);      // low part of PC
+        write_byte(state, state->sp - 1, (ret >> 8) & 0xff); // high part of PC
+        write_byte(state, state->sp - 2, (ret & 0xff));      // low part of PC
         state->sp = state->sp - 2;
         // Jump to the address $00
         state->pc = 0x00;
@@ -2245,8 +2236,8 @@ int emulate_i8080(State8080 *state)
             // call addr
             uint16_t ret = state->pc + 3; // address to return to after the CALL
             // push return address onto the stack
-            state->memory[state->sp - 1] = (ret >> 8) & 0xFF;
-            state->memory[state->sp - 2] = ret & 0xFF;
+            write_byte(state, state->sp - 1, (ret >> 8) & 0xFF);
+            write_byte(state, state->sp - 2, ret & 0xFF);
             state->sp = state->sp - 2;
             // jump to address specified in the CALL instruction
             uint16_t target = (state->memory[state->pc + 2] << 8) | state->memory[state->pc + 1];
@@ -2290,8 +2281,8 @@ int emulate_i8080(State8080 *state)
         {
             uint16_t ret = state->pc + 3; // address to return to after the CALL
             // push return address onto the stack
-            state->memory[state->sp - 1] = (ret >> 8) & 0xFF;
-            state->memory[state->sp - 2] = ret & 0xFF;
+            write_byte(state, state->sp - 1, (ret >> 8) & 0xFF);
+            write_byte(state, state->sp - 2, ret & 0xFF);
             state->sp = state->sp - 2;
             // jump to address specified in the CALL instruction
             uint16_t target = (state->memory[state->pc + 2] << 8) | state->memory[state->pc + 1];
@@ -2317,8 +2308,8 @@ int emulate_i8080(State8080 *state)
     {
         // Save the current PC on the stack before jumping
         uint16_t ret = state->pc + 1;
-        state->memory[state->sp - 1] = (ret >> 8) & 0xff; // high part of PC
-        state->memory[state->sp - 2] = (ret & 0xff);      // low part of PC
+        write_byte(state, state->sp - 1, (ret >> 8) & 0xff); // high part of PC
+        write_byte(state, state->sp - 2, (ret & 0xff));      // low part of PC
         state->sp = state->sp - 2;
         // Jump to the address $08
         state->pc = 0x0008;
@@ -2385,8 +2376,8 @@ int emulate_i8080(State8080 *state)
             // call addr
             uint16_t ret = state->pc + 3; // address to return to after the CALL
             // push return address onto the stack
-            state->memory[state->sp - 1] = (ret >> 8) & 0xFF;
-            state->memory[state->sp - 2] = ret & 0xFF;
+            write_byte(state, state->sp - 1, (ret >> 8) & 0xFF);
+            write_byte(state, state->sp - 2, ret & 0xFF);
             state->sp = state->sp - 2;
             // jump to address specified in the CALL instruction
             uint16_t target = (state->memory[state->pc + 2] << 8) | state->memory[state->pc + 1];
@@ -2403,9 +2394,9 @@ int emulate_i8080(State8080 *state)
 
     case 0xd5: // PUSH D
         // Push D register onto the stack
-        state->memory[state->sp - 1] = state->d;
+        write_byte(state, state->sp - 1, state->d);
         // Push E register onto the stack
-        state->memory[state->sp - 2] = state->e;
+        write_byte(state, state->sp - 2, state->e);
         state->sp -= 2;
         state->pc++;
         cycles = 11;
@@ -2428,8 +2419,8 @@ int emulate_i8080(State8080 *state)
     {
         // Save the current PC on the stack before jumping
         uint16_t ret = state->pc + 1;
-        state->memory[state->sp - 1] = (ret >> 8) & 0xff; // high part of PC
-        state->memory[state->sp - 2] = (ret & 0xff);      // low part of PC
+        write_byte(state, state->sp - 1, (ret >> 8) & 0xff); // high part of PC
+        write_byte(state, state->sp - 2, (ret & 0xff));      // low part of PC
         state->sp = state->sp - 2;
         // Jump to the address $10
         state->pc = 0x0010;
@@ -2490,8 +2481,8 @@ int emulate_i8080(State8080 *state)
             // call addr
             uint16_t ret = state->pc + 3; // address to return to after the CALL
             // push return address onto the stack
-            state->memory[state->sp - 1] = (ret >> 8) & 0xFF;
-            state->memory[state->sp - 2] = ret & 0xFF;
+            write_byte(state, state->sp - 1, (ret >> 8) & 0xFF);
+            write_byte(state, state->sp - 2, ret & 0xFF);
             state->sp = state->sp - 2;
             // jump to address specified in the CALL instruction
             uint16_t target = (state->memory[state->pc + 2] << 8) | state->memory[state->pc + 1];
@@ -2529,8 +2520,8 @@ int emulate_i8080(State8080 *state)
     {
         // Save the current PC on the stack before jumping
         uint16_t ret = state->pc + 1;
-        state->memory[state->sp - 1] = (ret >> 8) & 0xff; // high part of PC
-        state->memory[state->sp - 2] = (ret & 0xff);      // low part of PC
+        write_byte(state, state->sp - 1, (ret >> 8) & 0xff); // high part of PC
+        write_byte(state, state->sp - 2, (ret & 0xff));      // low part of PC
         state->sp = state->sp - 2;
         // Jump to the address $18
         state->pc = 0x18;
@@ -2590,8 +2581,8 @@ int emulate_i8080(State8080 *state)
         state->h = state->memory[state->sp + 1];
 
         // write h and l to stack - this should be protected? try this for now.
-        state->memory[state->sp] = l;
-        state->memory[state->sp + 1] = h;
+        write_byte(state, state->sp, l);
+        write_byte(state, state->sp + 1, h);
 
         state->pc += 1;
         cycles = 18;
@@ -2606,8 +2597,8 @@ int emulate_i8080(State8080 *state)
             // call addr
             uint16_t ret = state->pc + 3; // address to return to after the CALL
             // push return address onto the stack
-            state->memory[state->sp - 1] = (ret >> 8) & 0xFF;
-            state->memory[state->sp - 2] = ret & 0xFF;
+            write_byte(state, state->sp - 1, (ret >> 8) & 0xFF);
+            write_byte(state, state->sp - 2, ret & 0xFF);
             state->sp = state->sp - 2;
             // jump to address specified in the CALL instruction
             uint16_t target = (state->memory[state->pc + 2] << 8) | state->memory[state->pc + 1];
@@ -2624,9 +2615,9 @@ int emulate_i8080(State8080 *state)
 
     case 0xe5: // PUSH H
         // push H register onto the stack
-        state->memory[state->sp - 1] = state->h;
+        write_byte(state, state->sp - 1, state->h);
         // Push L register onto the stack
-        state->memory[state->sp - 2] = state->l;
+        write_byte(state, state->sp - 2, state->l);
         state->sp -= 2;
         state->pc++;
         cycles = 11;
@@ -2652,8 +2643,8 @@ int emulate_i8080(State8080 *state)
     {
         // Save the current PC on the stack before jumping
         uint16_t ret = state->pc + 1;
-        state->memory[state->sp - 1] = (ret >> 8) & 0xff; // high part of PC
-        state->memory[state->sp - 2] = (ret & 0xff);      // low part of PC
+        write_byte(state, state->sp - 1, (ret >> 8) & 0xff); // high part of PC
+        write_byte(state, state->sp - 2, (ret & 0xff));      // low part of PC
         state->sp = state->sp - 2;
         // Jump to the address $00
         state->pc = 0x20;
@@ -2718,8 +2709,8 @@ int emulate_i8080(State8080 *state)
             // call addr
             uint16_t ret = state->pc + 3; // address to return to after the CALL
             // push return address onto the stack
-            state->memory[state->sp - 1] = (ret >> 8) & 0xFF;
-            state->memory[state->sp - 2] = ret & 0xFF;
+            write_byte(state, state->sp - 1, (ret >> 8) & 0xFF);
+            write_byte(state, state->sp - 2, ret & 0xFF);
             state->sp = state->sp - 2;
             // jump to address specified in the CALL instruction
             uint16_t target = (state->memory[state->pc + 2] << 8) | state->memory[state->pc + 1];
@@ -2759,8 +2750,8 @@ int emulate_i8080(State8080 *state)
     {
         // Save the current PC on the stack before jumping
         uint16_t ret = state->pc + 1;
-        state->memory[state->sp - 1] = (ret >> 8) & 0xff; // high part of PC
-        state->memory[state->sp - 2] = (ret & 0xff);      // low part of PC
+        write_byte(state, state->sp - 1, (ret >> 8) & 0xff); // high part of PC
+        write_byte(state, state->sp - 2, (ret & 0xff));      // low part of PC
         state->sp = state->sp - 2;
         // Jump to the address $00
         state->pc = 0x28;
@@ -2834,8 +2825,8 @@ int emulate_i8080(State8080 *state)
             // call addr
             uint16_t ret = state->pc + 3; // address to return to after the CALL
             // push return address onto the stack
-            state->memory[state->sp - 1] = (ret >> 8) & 0xFF;
-            state->memory[state->sp - 2] = ret & 0xFF;
+            write_byte(state, state->sp - 1, (ret >> 8) & 0xFF);
+            write_byte(state, state->sp - 2, ret & 0xFF);
             state->sp = state->sp - 2;
             // jump to address specified in the CALL instruction
             uint16_t target = (state->memory[state->pc + 2] << 8) | state->memory[state->pc + 1];
@@ -2854,13 +2845,13 @@ int emulate_i8080(State8080 *state)
     {
         // print the stack pointer before
         // printf("stack pointer before: %04x\n", state->sp);
-        state->memory[state->sp - 1] = state->a;
+        write_byte(state, state->sp - 1, state->a);
         uint8_t psw = (state->cc.z |
                        state->cc.s << 1 |
                        state->cc.p << 2 |
                        state->cc.cy << 3 |
                        state->cc.ac << 4);
-        state->memory[state->sp - 2] = psw;
+        write_byte(state, state->sp - 2, psw);
         state->sp -= 2;
         state->pc += 1;
         cycles = 11;
@@ -2890,8 +2881,8 @@ int emulate_i8080(State8080 *state)
     {
         // Save the current PC on the stack before jumping
         uint16_t ret = state->pc + 1;
-        state->memory[state->sp - 1] = (ret >> 8) & 0xff; // high part of PC
-        state->memory[state->sp - 2] = (ret & 0xff);      // low part of PC
+        write_byte(state, state->sp - 1, (ret >> 8) & 0xff); // high part of PC
+        write_byte(state, state->sp - 2, (ret & 0xff));      // low part of PC
         state->sp = state->sp - 2;
         // Jump to the address $30
         state->pc = 0x30;
@@ -2959,8 +2950,8 @@ int emulate_i8080(State8080 *state)
             // call addr
             uint16_t ret = state->pc + 3; // address to return to after the CALL
             // push return address onto the stack
-            state->memory[state->sp - 1] = (ret >> 8) & 0xFF;
-            state->memory[state->sp - 2] = ret & 0xFF;
+            write_byte(state, state->sp - 1, (ret >> 8) & 0xFF);
+            write_byte(state, state->sp - 2, ret & 0xFF);
             state->sp = state->sp - 2;
             // jump to address specified in the CALL instruction
             uint16_t target = (state->memory[state->pc + 2] << 8) | state->memory[state->pc + 1];
@@ -2998,8 +2989,8 @@ int emulate_i8080(State8080 *state)
         // Save the current PC on the stack before jumping
         {
             uint16_t ret = state->pc + 1;
-            state->memory[state->sp - 1] = (ret >> 8) & 0xff; // high part of PC
-            state->memory[state->sp - 2] = (ret & 0xff);      // low part of PC
+            write_byte(state, state->sp - 1, (ret >> 8) & 0xff); // high part of PC
+            write_byte(state, state->sp - 2, (ret & 0xff));      // low part of PC
             state->sp = state->sp - 2;
             // Jump to the address $38
             state->pc = 0x38;
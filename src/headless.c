@@ -0,0 +1,420 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "controls.h"
+#include "interrupts.h"
+#include "machine.h"
+#include "memory.h"
+#include "shots.h"
+#include "video.h"
+
+// headless runner: emulate a game as fast as the host allows, with no
+// window or sound card, and write screenshots of selected frames, a video of
+// every frame and/or the sound as a wav file. frame n is the screen at the
+// n-th vblank (RST 2), counting from 1. the keys can come from an input
+// file, so a run is repeatable down to the last byte of its output.
+
+// samples rendered at a time, a little over 5 frames
+#define WAV_BLOCK 4096
+
+static const struct
+{
+    const char *name;
+    uint8_t key;
+} key_names[] = {
+    {"coin", KEY_COIN},
+    {"p1_start", KEY_P1_START},
+    {"p2_start", KEY_P2_START},
+    {"p1_shoot", KEY_P1_SHOOT},
+    {"p1_left", KEY_P1_LEFT},
+    {"p1_right", KEY_P1_RIGHT},
+    {"p2_shoot", KEY_P2_SHOOT},
+    {"p2_left", KEY_P2_LEFT},
+    {"p2_right", KEY_P2_RIGHT},
+    {"tilt", KEY_TILT}};
+
+#define NUM_KEY_NAMES (int)(sizeof(key_names) / sizeof(key_names[0]))
+
+static void usage(const char *name)
+{
+    printf("usage: %s [options]\n", name);
+    printf("  --game N      game to run, 1-4 as in the game menu (default 1)\n");
+    printf("  --frames N    number of frames to emulate (default 600)\n");
+    printf("  --every N     write every Nth frame\n");
+    printf("  --at A,B,...  write these frames\n");
+    printf("  --png         write PNG files instead of PPM\n");
+    printf("  --scale N     pixels per screen pixel (default 1)\n");
+    printf("  --out PREFIX  start of the file names (default shot-)\n");
+    printf("  --y4m FILE    stream every frame as YUV4MPEG2 to FILE, - for stdout\n");
+    printf("  --wav FILE    write the sound as a 16-bit mono %d Hz wav file\n", MIX_RATE);
+    printf("  --synth       synthesize the sounds instead of playing the samples\n");
+    printf("  --input FILE  press keys from FILE: lines of a frame number and the keys\n");
+    printf("                held from that frame on (coin, p1_start, p2_start, p1_shoot,\n");
+    printf("                p1_left, p1_right, p2_shoot, p2_left, p2_right, tilt)\n");
+}
+
+// read an input file into the set of keys held during each frame, a bit per
+// entry of key_names. returns -1 if it can't be read or doesn't parse.
+static int parse_input(const char *path, uint16_t *held, int frames)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "unable to read %s\n", path);
+        return -1;
+    }
+
+    // a line sets the keys from its frame on, until the next line
+    uint8_t *changes = calloc(frames + 1, 1);
+    if (changes == NULL)
+    {
+        fclose(file);
+        return -1;
+    }
+    char line[256];
+    int number = 0;
+    int result = 0;
+    while (result == 0 && fgets(line, sizeof(line), file) != NULL)
+    {
+        number++;
+        char *save;
+        char *word = strtok_r(line, " \t\r\n", &save);
+        if (word == NULL || word[0] == '#')
+        {
+            continue;
+        }
+        char *end;
+        long frame = strtol(word, &end, 10);
+        if (*end != '\0' || frame < 1)
+        {
+            result = -1;
+            break;
+        }
+        uint16_t keys = 0;
+        while ((word = strtok_r(NULL, " \t\r\n", &save)) != NULL && word[0] != '#')
+        {
+            int k = 0;
+            while (k < NUM_KEY_NAMES && strcmp(word, key_names[k].name) != 0)
+            {
+                k++;
+            }
+            if (k == NUM_KEY_NAMES)
+            {
+                result = -1;
+                break;
+            }
+            keys |= 1 << k;
+        }
+        if (frame <= frames)
+        {
+            held[frame] = keys;
+            changes[frame] = 1;
+        }
+    }
+    fclose(file);
+    if (result < 0)
+    {
+        fprintf(stderr, "%s:%d: expected a frame number and key names\n", path, number);
+        free(changes);
+        return -1;
+    }
+
+    for (int frame = 1; frame <= frames; frame++)
+    {
+        if (!changes[frame])
+        {
+            held[frame] = held[frame - 1];
+        }
+    }
+    free(changes);
+    return 0;
+}
+
+// press and release keys to go from the keys held before to the keys held now
+static void apply_keys(SpaceInvadersMachine *machine, uint16_t before, uint16_t now)
+{
+    for (int k = 0; k < NUM_KEY_NAMES; k++)
+    {
+        if ((now & ~before) & 1 << k)
+        {
+            key_down(machine, key_names[k].key);
+        }
+        else if ((before & ~now) & 1 << k)
+        {
+            key_up(machine, key_names[k].key);
+        }
+    }
+}
+
+// mix the sound up to the machine's emulated time and append it to the wav
+// file. returns -1 if the write failed.
+static int write_audio(Mixer *mixer, FILE *wav, SpaceInvadersMachine *machine, uint64_t *rendered)
+{
+    static int16_t block[WAV_BLOCK];
+    uint64_t now = machine_cycles(machine) * MIX_RATE / CPU_CLOCK;
+    while (*rendered < now)
+    {
+        int count = now - *rendered < WAV_BLOCK ? now - *rendered : WAV_BLOCK;
+        mixer_render(mixer, block, count);
+        if (wav_write(wav, block, count) < 0)
+        {
+            return -1;
+        }
+        *rendered += count;
+    }
+    return 0;
+}
+
+// mark the frames in a comma separated list. returns -1 if it doesn't parse.
+static int parse_frames(const char *list, uint8_t *wanted, int frames)
+{
+    const char *p = list;
+    for (;;)
+    {
+        char *end;
+        long frame = strtol(p, &end, 10);
+        if (end == p || frame < 1)
+        {
+            return -1;
+        }
+        if (frame <= frames)
+        {
+            wanted[frame] = 1;
+        }
+        if (*end == '\0')
+        {
+            return 0;
+        }
+        if (*end != ',')
+        {
+            return -1;
+        }
+        p = end + 1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int game = GAME_INVADERS;
+    int frames = 600;
+    int every = 0;
+    const char *at = NULL;
+    int format = SHOT_PPM;
+    int scale = 1;
+    const char *prefix = "shot-";
+    const char *y4m = NULL;
+    const char *wav_path = NULL;
+    const char *input = NULL;
+    int synth = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        int more = i + 1 < argc;
+        if (strcmp(argv[i], "--game") == 0 && more)
+        {
+            game = atoi(argv[++i]) - 1;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && more)
+        {
+            frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--every") == 0 && more)
+        {
+            every = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--at") == 0 && more)
+        {
+            at = argv[++i];
+        }
+        else if (strcmp(argv[i], "--png") == 0)
+        {
+            format = SHOT_PNG;
+        }
+        else if (strcmp(argv[i], "--scale") == 0 && more)
+        {
+            scale = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && more)
+        {
+            prefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--y4m") == 0 && more)
+        {
+            y4m = argv[++i];
+        }
+        else if (strcmp(argv[i], "--wav") == 0 && more)
+        {
+            wav_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--synth") == 0)
+        {
+            synth = 1;
+        }
+        else if (strcmp(argv[i], "--input") == 0 && more)
+        {
+            input = argv[++i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (game < GAME_INVADERS || game >= NUM_GAMES || frames < 1 || every < 0 || scale < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint8_t *wanted = calloc(frames + 1, 1);
+    uint16_t *held = calloc(frames + 1, sizeof(uint16_t));
+    if (wanted == NULL || held == NULL)
+    {
+        free(wanted);
+        free(held);
+        return 1;
+    }
+    for (int frame = every; every > 0 && frame <= frames; frame += every)
+    {
+        wanted[frame] = 1;
+    }
+    if (at != NULL && parse_frames(at, wanted, frames) < 0)
+    {
+        fprintf(stderr, "bad frame list: %s\n", at);
+        free(wanted);
+        free(held);
+        return 1;
+    }
+    if (input != NULL && parse_input(input, held, frames) < 0)
+    {
+        free(wanted);
+        free(held);
+        return 1;
+    }
+
+    SpaceInvadersMachine *machine = machine_create();
+    if (machine == NULL)
+    {
+        fprintf(stderr, "could not allocate the machine\n");
+        free(wanted);
+        free(held);
+        return 1;
+    }
+    if (mem_init_game(machine, game) < 0)
+    {
+        machine_destroy(machine);
+        free(wanted);
+        free(held);
+        return 1;
+    }
+
+    // sound only if a wav file was asked for. emulated time 0 is its first
+    // sample, nothing plays ahead of it offline.
+    Mixer *mixer = NULL;
+    FILE *wav = NULL;
+    if (wav_path != NULL)
+    {
+        mixer = audio_create(game, synth);
+        wav = mixer != NULL ? wav_open(wav_path) : NULL;
+        if (wav == NULL)
+        {
+            mixer_destroy(mixer);
+            machine_destroy(machine);
+            free(wanted);
+            free(held);
+            return 1;
+        }
+        mixer_sync(mixer, 0);
+        machine->sound.mixer = mixer;
+        machine->sound.synth = synth;
+    }
+
+    // the writers report a closed pipe as a failed write instead
+    signal(SIGPIPE, SIG_IGN);
+
+    // screenshots only if some frame was asked for
+    ShotWriter *writer = NULL;
+    ShotWriter *video = NULL;
+    if (every > 0 || at != NULL)
+    {
+        writer = shots_start(prefix, format, game, scale);
+    }
+    if (y4m != NULL)
+    {
+        video = shots_start(y4m, SHOT_Y4M, game, scale);
+    }
+    if ((writer == NULL && (every > 0 || at != NULL)) || (video == NULL && y4m != NULL))
+    {
+        if (writer != NULL)
+        {
+            shots_finish(writer);
+        }
+        if (video != NULL)
+        {
+            shots_finish(video);
+        }
+        if (wav != NULL)
+        {
+            wav_close(wav);
+            mixer_destroy(mixer);
+        }
+        machine_destroy(machine);
+        free(wanted);
+        free(held);
+        return 1;
+    }
+
+    // offline there is no deadline to keep, so the emulation waits for the
+    // writers rather than dropping frames
+    int written = 0;
+    uint64_t rendered = 0;
+    int sound_failed = 0;
+    for (int frame = 1; frame <= frames; frame++)
+    {
+        apply_keys(machine, held[frame - 1], held[frame]);
+        run_frame(machine);
+        if (wav != NULL && !sound_failed)
+        {
+            sound_failed = write_audio(mixer, wav, machine, &rendered) < 0;
+        }
+        const uint8_t *vram = &machine->state.memory[VRAM_START];
+        if (wanted[frame])
+        {
+            shots_queue(writer, frame, vram);
+            written++;
+        }
+        if (video != NULL)
+        {
+            shots_queue(video, frame, vram);
+        }
+    }
+
+    // stdout may be the video, so the summary goes to stderr
+    int failed = writer != NULL ? shots_finish(writer) : 0;
+    int lost = video != NULL ? shots_finish(video) : 0;
+    fprintf(stderr, "%d frames, %d screenshots written", frames, written - failed);
+    if (video != NULL)
+    {
+        fprintf(stderr, ", %d video frames to %s", frames - lost, y4m);
+    }
+    if (wav != NULL)
+    {
+        sound_failed |= wav_close(wav) < 0;
+        mixer_destroy(mixer);
+        machine->sound.mixer = NULL;
+        fprintf(stderr, ", %s", sound_failed ? "failed to write the sound" : "sound");
+        if (!sound_failed)
+        {
+            fprintf(stderr, " (%.2f s) to %s", (double)rendered / MIX_RATE, wav_path);
+        }
+    }
+    fprintf(stderr, "\n");
+
+    machine_destroy(machine);
+    free(wanted);
+    free(held);
+    return failed > 0 || lost > 0 || sound_failed;
+}
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "games.h"
+#include "interrupts.h"
+#include "memory.h"
+
+const char *wav_files[] = {
+    "./sounds/0.wav",
+    "./sounds/1.wav",
+    "./sounds/2.wav",
+    "./sounds/3.wav",
+    "./sounds/4.wav",
+    "./sounds/5.wav",
+    "./sounds/6.wav",
+    "./sounds/7.wav",
+    "./sounds/8.wav"};
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+// whole file in memory. returns NULL if it can't be read.
+static uint8_t *read_file(const char *path, long *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = *size > 0 ? malloc(*size) : NULL;
+    if (data != NULL && fread(data, 1, *size, file) != (size_t)*size)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+int16_t *audio_load_wav(const char *path, int *length)
+{
+    long size;
+    uint8_t *file = read_file(path, &size);
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    if (size < 12 || memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0)
+    {
+        free(file);
+        return NULL;
+    }
+
+    // find the format and the samples
+    int channels = 0, rate = 0, bits = 0;
+    const uint8_t *data = NULL;
+    uint32_t data_size = 0;
+    for (long i = 12; i + 8 <= size;)
+    {
+        uint32_t chunk = get_le32(file + i + 4);
+        if (chunk > size - i - 8)
+        {
+            chunk = size - i - 8;
+        }
+        if (memcmp(file + i, "fmt ", 4) == 0 && chunk >= 16 && get_le16(file + i + 8) == 1)
+        {
+            channels = get_le16(file + i + 10);
+            rate = get_le32(file + i + 12);
+            bits = get_le16(file + i + 22);
+        }
+        else if (memcmp(file + i, "data", 4) == 0)
+        {
+            data = file + i + 8;
+            data_size = chunk;
+        }
+        i += 8 + chunk + (chunk & 1);
+    }
+    int bytes = bits / 8;
+    if (data == NULL || channels < 1 || rate < 1 || (bits != 8 && bits != 16))
+    {
+        free(file);
+        return NULL;
+    }
+
+    // mono, 16 bits
+    int frames = data_size / (bytes * channels);
+    int16_t *mono = malloc((frames + 1) * sizeof(int16_t));
+    if (mono == NULL)
+    {
+        free(file);
+        return NULL;
+    }
+    for (int f = 0; f < frames; f++)
+    {
+        int sum = 0;
+        for (int c = 0; c < channels; c++)
+        {
+            const uint8_t *p = data + (f * channels + c) * bytes;
+            sum += bits == 8 ? (p[0] - 128) << 8 : (int16_t)get_le16(p);
+        }
+        mono[f] = sum / channels;
+    }
+    free(file);
+
+    // resample to MIX_RATE by linear interpolation, in 16.16 fixed point
+    // so every machine produces the same samples
+    int out_frames = (int)((uint64_t)frames * MIX_RATE / rate);
+    int16_t *out = malloc((out_frames > 0 ? out_frames : 1) * sizeof(int16_t));
+    if (out == NULL || out_frames == 0)
+    {
+        free(out);
+        free(mono);
+        return NULL;
+    }
+    mono[frames] = mono[frames - 1];
+    for (int i = 0; i < out_frames; i++)
+    {
+        uint64_t pos = ((uint64_t)i * rate << 16) / MIX_RATE;
+        int index = pos >> 16;
+        int frac = pos & 0xffff;
+        out[i] = mono[index] + (((mono[index + 1] - mono[index]) * frac) >> 16);
+    }
+    free(mono);
+    *length = out_frames;
+    return out;
+}
+
+Mixer *audio_create(int game, int synth)
+{
+    Mixer *mixer = mixer_create();
+    if (mixer == NULL || synth)
+    {
+        return mixer;
+    }
+
+    // the game's own bank, or else the Space Invaders one, needs no decoding
+    if (game < GAME_INVADERS || game >= NUM_GAMES)
+    {
+        game = GAME_INVADERS;
+    }
+    if (mixer_load_bank(mixer, games[game].bank) >= 0 || mixer_load_bank(mixer, games[GAME_INVADERS].bank) >= 0)
+    {
+        return mixer;
+    }
+    for (int i = 0; i < NUM_SOUNDS; i++)
+    {
+        int length;
+        int16_t *samples = audio_load_wav(wav_files[i], &length);
+        if (samples == NULL || mixer_load(mixer, i, samples, length) < 0)
+        {
+            fprintf(stderr, "unable to load wav file: %s\n", wav_files[i]);
+        }
+        free(samples);
+    }
+    return mixer;
+}
+
+// function to play sounds - ref http://www.emulator101.com/cocoa-port-pt-5---sound.html
+// create variables to hold the previous state of OUT 3 and OUT 5
+// when the state changes from 0 to 1, play the sound.
+void play_sounds(SpaceInvadersMachine *machine)
+{
+    Mixer *mixer = machine->sound.mixer;
+    if (mixer == NULL)
+    {
+        return;
+    }
+
+    // the emulated time of this OUT, in output samples. the mixer starts
+    // the sound at that sample rather than whenever the command arrives.
+    uint64_t at = machine_cycles(machine) * MIX_RATE / CPU_CLOCK;
+
+    // the synthesizer follows the port bits themselves, every change of them
+    if (machine->sound.synth)
+    {
+        if (machine->out_port_3 != machine->prev_out_port_3)
+        {
+            mixer_port(mixer, 3, machine->out_port_3, at);
+            machine->prev_out_port_3 = machine->out_port_3;
+        }
+        if (machine->out_port_5 != machine->prev_out_port_5)
+        {
+            mixer_port(mixer, 5, machine->out_port_5, at);
+            machine->prev_out_port_5 = machine->out_port_5;
+        }
+        return;
+    }
+
+    // each sample the game's table (games.c) has for a bit that went on
+    // starts, and a looping one stops when its bit goes off again
+    const GameInfo *info = &games[machine->game];
+    for (int i = 0; i < info->num_sounds; i++)
+    {
+        const GameSound *sound = &info->sound[i];
+        uint8_t now = sound->output == OUT_SOUND1 ? machine->out_port_3 : machine->out_port_5;
+        uint8_t prev = sound->output == OUT_SOUND1 ? machine->prev_out_port_3 : machine->prev_out_port_5;
+        if ((now & sound->mask) && !(prev & sound->mask))
+        {
+            mixer_play(mixer, sound->sample, sound->loop, at);
+        }
+        else if (sound->loop && !(now & sound->mask) && (prev & sound->mask))
+        {
+            // stop playing the looping sound, and only that
+            mixer_stop(mixer, sound->sample, at);
+        }
+    }
+    machine->prev_out_port_3 = machine->out_port_3;
+    machine->prev_out_port_5 = machine->out_port_5;
+}
+
+// header of a 16-bit mono wav file with room for size bytes of samples
+static void wav_header(uint8_t *header, uint32_t size)
+{
+    memcpy(header, "RIFF", 4);
+    put_le32(header + 4, 36 + size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le32(header + 16, 16);
+    put_le32(header + 20, 1 | 1 << 16); // PCM, mono
+    put_le32(header + 24, MIX_RATE);
+    put_le32(header + 28, MIX_RATE * 2);
+    put_le32(header + 32, 2 | 16 << 16); // 2 bytes per frame, 16 bits
+    memcpy(header + 36, "data", 4);
+    put_le32(header + 40, size);
+}
+
+FILE *wav_open(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "unable to write %s\n", path);
+        return NULL;
+    }
+    uint8_t header[44];
+    wav_header(header, 0);
+    fwrite(header, 1, sizeof(header), file);
+    return file;
+}
+
+int wav_write(FILE *file, const int16_t *samples, int count)
+{
+    // wav is little endian whatever the host is
+    uint8_t bytes[512];
+    for (int i = 0; i < count; i += 256)
+    {
+        int n = count - i < 256 ? count - i : 256;
+        for (int k = 0; k < n; k++)
+        {
+            bytes[2 * k] = samples[i + k];
+            bytes[2 * k + 1] = (uint16_t)samples[i + k] >> 8;
+        }
+        if (fwrite(bytes, 2, n, file) != (size_t)n)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int wav_close(FILE *file)
+{
+    long size = ftell(file) - 44;
+    uint8_t header[44];
+    wav_header(header, size);
+    int failed = size < 0 || fseek(file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), file) != sizeof(header);
+    failed |= ferror(file) != 0;
+    failed |= fclose(file) != 0;
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,138 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bank.h"
+#include "mixer.h"
+
+// where the samples of the entry after one ending at offset start
+static uint64_t align(uint64_t offset)
+{
+    return (offset + BANK_ALIGN - 1) / BANK_ALIGN * BANK_ALIGN;
+}
+
+// a bank mapped from a file nobody else writes can only be wrong if it was
+// made for another host or MIX_RATE, or got cut short
+static int bank_valid(const SoundBank *bank)
+{
+    const BankHeader *header = bank->header;
+    if (bank->size < sizeof(BankHeader) || memcmp(header->magic, BANK_MAGIC, 8) != 0 ||
+        header->version != BANK_VERSION || header->byte_order != BANK_BYTE_ORDER || header->rate != MIX_RATE ||
+        header->count > MIX_SOUNDS || bank->size < sizeof(BankHeader) + header->count * sizeof(BankEntry))
+    {
+        return 0;
+    }
+    for (uint32_t i = 0; i < header->count; i++)
+    {
+        const BankEntry *entry = &header->entry[i];
+        if (entry->offset % BANK_ALIGN != 0 || entry->offset > bank->size ||
+            entry->length > (bank->size - entry->offset) / sizeof(int16_t))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int bank_open(SoundBank *bank, const char *path)
+{
+    bank->map = NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+    bank->map = map;
+    bank->size = st.st_size;
+    bank->header = map;
+    if (!bank_valid(bank))
+    {
+        fprintf(stderr, "%s is not a sound bank for this build, remake it with make bank\n", path);
+        bank_close(bank);
+        return -1;
+    }
+    return 0;
+}
+
+void bank_close(SoundBank *bank)
+{
+    if (bank->map != NULL)
+    {
+        munmap(bank->map, bank->size);
+        bank->map = NULL;
+    }
+}
+
+const int16_t *bank_sound(const SoundBank *bank, int sound, int *length)
+{
+    if (bank->map == NULL || sound < 0 || (uint32_t)sound >= bank->header->count ||
+        bank->header->entry[sound].length == 0)
+    {
+        return NULL;
+    }
+    const BankEntry *entry = &bank->header->entry[sound];
+    *length = entry->length;
+    return (const int16_t *)((const uint8_t *)bank->map + entry->offset);
+}
+
+int bank_write(const char *path, int16_t *const *samples, const int *length, int count)
+{
+    if (count < 0 || count > MIX_SOUNDS)
+    {
+        return -1;
+    }
+    size_t header_size = sizeof(BankHeader) + count * sizeof(BankEntry);
+    BankHeader *header = calloc(1, header_size);
+    if (header == NULL)
+    {
+        return -1;
+    }
+    memcpy(header->magic, BANK_MAGIC, 8);
+    header->version = BANK_VERSION;
+    header->byte_order = BANK_BYTE_ORDER;
+    header->rate = MIX_RATE;
+    header->count = count;
+    uint64_t offset = align(header_size);
+    for (int i = 0; i < count; i++)
+    {
+        header->entry[i].offset = offset;
+        header->entry[i].length = samples[i] != NULL ? length[i] : 0;
+        offset = align(offset + header->entry[i].length * sizeof(int16_t));
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        free(header);
+        return -1;
+    }
+    static const uint8_t zeros[BANK_ALIGN] = {0};
+    int failed = fwrite(header, header_size, 1, file) != 1;
+    uint64_t written = header_size;
+    for (int i = 0; i < count && !failed; i++)
+    {
+        const BankEntry *entry = &header->entry[i];
+        failed |= fwrite(zeros, 1, entry->offset - written, file) != entry->offset - written;
+        failed |= fwrite(samples[i], sizeof(int16_t), entry->length, file) != entry->length;
+        written = entry->offset + entry->length * sizeof(int16_t);
+    }
+    failed |= fclose(file) != 0;
+    free(header);
+    return failed ? -1 : 0;
+}
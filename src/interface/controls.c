@@ -1,85 +1,68 @@
-#include <SDL2/SDL.h>
+#include <stddef.h>
 
 #include "controls.h"
+#include "games.h"
 #include "processor.h"
 
-// functions to accept key events
-void key_down(SpaceInvadersMachine *machine, uint8_t key)
+// the input byte a key is in, NULL if the game's board has no such key
+static uint8_t *key_byte(SpaceInvadersMachine *machine, const GameKey *key)
 {
-    switch (key)
+    switch (key->input)
     {
-    case KEY_COIN:               // need to define these
-        machine->in_port |= 0x1; // set to 00000001 (bit 0)
-        break;
-    case KEY_P1_LEFT:
-        machine->in_port |= 0x20; // set to 00100000 (bit 5)
-        break;
-    case KEY_P1_RIGHT:
-        machine->in_port |= 0x40; // set to 01000000 (bit 6)
-        break;
-    case KEY_P1_START:
-        machine->in_port |= 0x4; // set to 00000100 (bit 2)
-        break;
-    case KEY_P1_SHOOT:
-        machine->in_port |= 0x10; // set to 00010000 (bit 4)
-        break;
-
-    // player 2
-    case KEY_P2_LEFT:               // port 2 - bit 5
-        machine->in_port_2 |= 0x20; // set to 00100000 (bit 5)
-        break;
-    case KEY_P2_RIGHT:              // port 2 - bit 6
-        machine->in_port_2 |= 0x40; // set to 01000000 (bit 6)
-        break;
-    case KEY_P2_SHOOT:              // port 2 - bit 4
-        machine->in_port_2 |= 0x10; // set to 00010000 (bit 4)
-        break;
-    case KEY_P2_START:           // port 1 - bit 1
-        machine->in_port |= 0x2; // set to 00000010 (bit 1)
-        break;
+    case IN_PLAYER1:
+        return &machine->in_port;
+    case IN_PLAYER2:
+        return &machine->in_port_2;
+    }
+    return NULL;
+}
 
-    case KEY_TILT: // port 2 - bit 2
-        machine->in_port_2 |= 0x4;
-        break;
+// functions to accept key events. games.c says which bit each key sets.
+void key_down(SpaceInvadersMachine *machine, uint8_t key)
+{
+    if (key >= NUM_KEYS)
+    {
+        return;
+    }
+    const GameKey *k = &games[machine->game].key[key];
+    uint8_t *byte = key_byte(machine, k);
+    if (byte != NULL)
+    {
+        *byte |= k->mask;
     }
 }
 
 void key_up(SpaceInvadersMachine *machine, uint8_t key)
 {
-    switch (key)
+    if (key >= NUM_KEYS)
     {
-    case KEY_COIN:
-        machine->in_port &= ~0x1;
-        break;
-    case KEY_P1_LEFT:
-        machine->in_port &= ~0x20;
-        break;
-    case KEY_P1_RIGHT:
-        machine->in_port &= ~0x40;
-        break;
-    case KEY_P1_START:
-        machine->in_port &= ~0x4;
-        break;
-    case KEY_P1_SHOOT:
-        machine->in_port &= ~0x10;
-        break;
-
-    // player 2
-    case KEY_P2_LEFT: // port 2 - bit 5
-        machine->in_port_2 &= ~0x20;
-        break;
-    case KEY_P2_RIGHT: // port 2 - bit 6
-        machine->in_port_2 &= ~0x40;
-        break;
-    case KEY_P2_SHOOT: // port 2 - bit 4
-        machine->in_port_2 &= ~0x10;
-        break;
-    case KEY_P2_START: // port 1 - bit 1
-        machine->in_port &= ~0x2;
-        break;
+        return;
+    }
+    const GameKey *k = &games[machine->game].key[key];
+    uint8_t *byte = key_byte(machine, k);
+    if (byte != NULL)
+    {
+        *byte &= ~k->mask;
+    }
+}
 
-    case KEY_TILT: // port 2 - bit 2
-        machine->in_port_2 &= ~0x04;
-        break;
+void keys_sample(SpaceInvadersMachine *machine)
+{
+    unsigned int keys = atomic_load_explicit(machine->keys, memory_order_relaxed);
+    unsigned int changed = keys ^ machine->keys_applied;
+    for (int key = 0; changed != 0; key++, changed >>= 1)
+    {
+        if (changed & 1)
+        {
+            if (keys & (1u << key))
+            {
+                key_down(machine, key);
+            }
+            else
+            {
+                key_up(machine, key);
+            }
+        }
     }
-}
\ No newline at end of file
+    machine->keys_applied = keys;
+}
@@ -1,36 +1,99 @@
 
 #include <SDL2/SDL.h>
 
+#include "display.h"
+#include "overlay.h"
 #include "processor.h"
+#include "video.h"
+
+// the window shows a 224x256 texture that SDL scales to the window size.
+// pixels keeps a copy of it, so only the columns that changed are drawn and
+// uploaded; the texture itself is write-only.
+static SDL_Renderer *renderer = NULL;
+static SDL_Texture *texture = NULL;
+static uint32_t pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
+static uint32_t row_color[SCREEN_HEIGHT]; // overlay colour of every row
 
 // return the location of the video memory in the machine.
 void *get_framebuffer(State8080 *state)
 {
-    return (void *)&state->memory[0x2400];
+    return (void *)&state->memory[VRAM_START];
+}
+
+// return the dirty flags of the video memory, one per screen column.
+uint8_t *get_dirty_columns(State8080 *state)
+{
+    return &state->dirty_lines[VRAM_START >> LINE_SHIFT];
 }
 
-// wipe SDL surface
-void wipe_surface(SDL_Surface *surface)
+// set up the renderer and the screen texture for the window, with the
+// colour overlay of the game. uses the GPU if there is one and SDL's
+// software renderer otherwise.
+int init_display(SDL_Window *window, int game)
 {
-    /* This is fast for surfaces that don't require locking. */
-    /* Once locked, surface->pixels is safe to access. */
-    SDL_LockSurface(surface);
+    // keep the pixels square and sharp at any window size
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    if (renderer == NULL)
+    {
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    }
+    if (renderer == NULL)
+    {
+        printf("unable to create renderer: %s\n", SDL_GetError());
+        return -1;
+    }
+    SDL_RenderSetLogicalSize(renderer, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH,
+                                SCREEN_HEIGHT);
+    if (texture == NULL)
+    {
+        printf("unable to create screen texture: %s\n", SDL_GetError());
+        SDL_DestroyRenderer(renderer);
+        renderer = NULL;
+        return -1;
+    }
 
-    /* This assumes that color value zero is black. Use
-       SDL_MapRGBA() for more robust surface color mapping! */
-    /* height times pitch is the size of the surface's whole buffer. */
-    SDL_memset(surface->pixels, 0, surface->h * surface->pitch);
+    overlay_rows(row_color, game);
+    return 0;
+}
+
+void close_display(void)
+{
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    texture = NULL;
+    renderer = NULL;
+}
 
-    SDL_UnlockSurface(surface);
+// draw the columns of video memory written since the last call, upload them
+// and show the frame. does nothing if no column changed.
+void draw_screen(const uint8_t *vram, uint8_t *columns)
+{
+    int pitch = SCREEN_WIDTH * sizeof(uint32_t);
+    int changed = 0;
+    int x = 0;
+    int width;
+    while ((width = video_next_run(columns, &x)) > 0)
+    {
+        video_render_columns(pixels, pitch, vram, row_color, 1, x, width);
+        SDL_Rect rect = {x, 0, width, SCREEN_HEIGHT};
+        SDL_UpdateTexture(texture, &rect, pixels + x, pitch);
+        changed = 1;
+        x += width;
+    }
+    if (changed)
+    {
+        present_screen();
+    }
 }
 
-// set a pixel color.
-void set_pixel(SDL_Surface *surface, int x, int y, uint8_t r, uint8_t g, uint8_t b)
+// show the texture again, e.g. after the window was resized or uncovered
+void present_screen(void)
 {
-    SDL_LockSurface(surface);
-    uint8_t *pixelArray = (uint8_t *)surface->pixels;
-    pixelArray[y * surface->pitch + x * surface->format->BytesPerPixel + 0] = g;
-    pixelArray[y * surface->pitch + x * surface->format->BytesPerPixel + 1] = b;
-    pixelArray[y * surface->pitch + x * surface->format->BytesPerPixel + 2] = r;
-    SDL_UnlockSurface(surface);
-}
\ No newline at end of file
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
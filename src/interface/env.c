@@ -0,0 +1,294 @@
+#include <stdlib.h>
+
+#include "controls.h"
+#include "env.h"
+#include "interrupts.h"
+#include "machine.h"
+#include "memory.h"
+
+// RAM locations used for rewards and termination.
+// see https://www.computerarcheology.com/Arcade/SpaceInvaders/RAMUse.html
+// an address of 0 means the location is unknown for that game, in which case
+// the reward is always 0 and only the caller can end an episode.
+typedef struct EnvGameInfo
+{
+    uint16_t score;  // BCD score, low byte first (2 bytes)
+    uint16_t ships;  // ships in reserve, not counting the one in play
+    uint16_t alive;  // 0xff while the ship in play is alive
+    uint16_t mode;   // non-zero while a game is being played
+} EnvGameInfo;
+
+static const EnvGameInfo game_info[NUM_GAMES] = {
+    [GAME_INVADERS] = {0x20f8, 0x21ff, 0x2015, 0x20ef},
+    [GAME_INVADERS_DX] = {0, 0, 0, 0},
+    [GAME_LRESCUE] = {0, 0, 0, 0},
+    [GAME_BALLOON] = {0, 0, 0, 0},
+};
+
+// frames to hold each button while starting a game, and how long to wait for it
+#define START_PRESS_FRAMES 5
+#define START_TIMEOUT_FRAMES 600
+
+struct Env
+{
+    SpaceInvadersMachine *machine;
+    int obs_type;
+    int game;    // game whose ROMs are in rom[], -1 before the first reset
+    int score;   // score at the end of the last step
+    int playing; // set once the game has started, cleared when it ends
+    MachineSnapshot *start; // machine right after loading the game and resetting
+    uint8_t gray[ENV_GRAY_SIZE];
+};
+
+Env *env_create(int obs_type)
+{
+    Env *env = calloc(1, sizeof(Env));
+    if (env == NULL)
+    {
+        return NULL;
+    }
+    env->machine = machine_create();
+    if (env->machine == NULL)
+    {
+        env_destroy(env);
+        return NULL;
+    }
+    env->obs_type = obs_type;
+    env->game = -1;
+    return env;
+}
+
+void env_destroy(Env *env)
+{
+    if (env == NULL)
+    {
+        return;
+    }
+    if (env->machine != NULL)
+    {
+        machine_destroy(env->machine);
+    }
+    if (env->start != NULL)
+    {
+        snapshot_destroy(env->start);
+    }
+    free(env);
+}
+
+size_t env_observation_size(const Env *env)
+{
+    return env->obs_type == ENV_OBS_GRAY ? ENV_GRAY_SIZE : ENV_VRAM_SIZE;
+}
+
+// decode the 4 digit BCD score
+static int read_score(const Env *env)
+{
+    uint16_t addr = game_info[env->game].score;
+    if (addr == 0)
+    {
+        return 0;
+    }
+    uint8_t lo = env->machine->memory[addr];
+    uint8_t hi = env->machine->memory[addr + 1];
+    return (hi >> 4) * 1000 + (hi & 0xf) * 100 + (lo >> 4) * 10 + (lo & 0xf);
+}
+
+static int in_game(const Env *env)
+{
+    uint16_t addr = game_info[env->game].mode;
+    return addr != 0 && env->machine->memory[addr] != 0;
+}
+
+// the last ship was hit: no lives left. the game goes on to show it blow
+// up and the game over screen, which the episode doesn't need.
+static int out_of_lives(const Env *env)
+{
+    const EnvGameInfo *info = &game_info[env->game];
+    const uint8_t *memory = env->machine->memory;
+    return info->ships != 0 && info->alive != 0 && memory[info->ships] == 0 && memory[info->alive] != 0xff;
+}
+
+// hold a key for a few frames and let go of it
+static void press(SpaceInvadersMachine *machine, uint8_t key)
+{
+    key_down(machine, key);
+    for (int i = 0; i < START_PRESS_FRAMES; i++)
+    {
+        run_frame(machine);
+    }
+    key_up(machine, key);
+    for (int i = 0; i < START_PRESS_FRAMES; i++)
+    {
+        run_frame(machine);
+    }
+}
+
+int env_reset(Env *env, int game)
+{
+    SpaceInvadersMachine *machine = env->machine;
+
+    // read the ROMs once per game, afterwards restore the snapshot, which
+    // only copies back the pages the last episode changed
+    if (game != env->game)
+    {
+        env->game = -1;
+        if (env->start != NULL)
+        {
+            snapshot_destroy(env->start);
+            env->start = NULL;
+        }
+        if (mem_init_game(machine, game) < 0)
+        {
+            return -1;
+        }
+        machine_reset(machine);
+        env->start = machine_snapshot(machine);
+        if (env->start == NULL)
+        {
+            return -1;
+        }
+        env->game = game;
+    }
+    else
+    {
+        machine_restore(machine, env->start);
+    }
+
+    // let the game boot, then coin up and hold start until the game begins
+    for (int i = 0; i < 2 * START_PRESS_FRAMES; i++)
+    {
+        run_frame(machine);
+    }
+    press(machine, KEY_COIN);
+
+    key_down(machine, KEY_P1_START);
+    int frames = 0;
+    if (game_info[game].mode != 0)
+    {
+        while (!in_game(env) && frames < START_TIMEOUT_FRAMES)
+        {
+            run_frame(machine);
+            frames++;
+        }
+    }
+    else
+    {
+        // no way to tell when the game started, give it a second
+        for (; frames < 60; frames++)
+        {
+            run_frame(machine);
+        }
+    }
+    key_up(machine, KEY_P1_START);
+    if (game_info[game].mode != 0 && !in_game(env))
+    {
+        return -1;
+    }
+
+    env->playing = 1;
+    env->score = read_score(env);
+    return 0;
+}
+
+// downsample the rotated 1bpp screen to 112x128 gray levels.
+// video RAM column x holds screen column x, bit 0 of byte 0 is the bottom row.
+static void build_gray(Env *env)
+{
+    // gray level for each combination of the 2x2 block's 4 bits
+    static const uint8_t level[16] = {0, 64, 64, 128, 64, 128, 128, 191,
+                                      64, 128, 128, 191, 128, 191, 191, 255};
+    const uint8_t *vram = &env->machine->memory[0x2400];
+
+    for (int ox = 0; ox < ENV_GRAY_WIDTH; ox++)
+    {
+        const uint8_t *col0 = vram + (2 * ox) * 32;
+        const uint8_t *col1 = col0 + 32;
+        for (int yb = 0; yb < 32; yb++)
+        {
+            uint8_t a = col0[yb];
+            uint8_t b = col1[yb];
+            uint8_t *out = &env->gray[((ENV_GRAY_HEIGHT - 1) - yb * 4) * ENV_GRAY_WIDTH + ox];
+            if ((a | b) == 0)
+            {
+                // most of the screen is empty
+                out[0] = out[-ENV_GRAY_WIDTH] = out[-2 * ENV_GRAY_WIDTH] = out[-3 * ENV_GRAY_WIDTH] = 0;
+                continue;
+            }
+            // each byte covers 8 rows -> 4 output rows, bottom row first
+            for (int k = 0; k < 4; k++)
+            {
+                int block = ((a >> (2 * k)) & 3) | (((b >> (2 * k)) & 3) << 2);
+                out[-k * ENV_GRAY_WIDTH] = level[block];
+            }
+        }
+    }
+}
+
+int env_step(Env *env, int action, int frames, EnvStep *result)
+{
+    SpaceInvadersMachine *machine = env->machine;
+    if (env->game < 0)
+    {
+        return -1;
+    }
+
+    // the action is held for every frame of the step
+    if (action & ENV_LEFT)
+    {
+        key_down(machine, KEY_P1_LEFT);
+    }
+    else
+    {
+        key_up(machine, KEY_P1_LEFT);
+    }
+    if (action & ENV_RIGHT)
+    {
+        key_down(machine, KEY_P1_RIGHT);
+    }
+    else
+    {
+        key_up(machine, KEY_P1_RIGHT);
+    }
+    if (action & ENV_FIRE)
+    {
+        key_down(machine, KEY_P1_SHOOT);
+    }
+    else
+    {
+        key_up(machine, KEY_P1_SHOOT);
+    }
+
+    int ran = 0;
+    while (ran < frames && env->playing)
+    {
+        run_frame(machine);
+        ran++;
+        if ((game_info[env->game].mode != 0 && !in_game(env)) || out_of_lives(env))
+        {
+            env->playing = 0;
+        }
+    }
+
+    int score = read_score(env);
+    result->reward = score - env->score;
+    if (result->reward < 0)
+    {
+        // the 4 digit score rolled over
+        result->reward += 10000;
+    }
+    env->score = score;
+    result->done = !env->playing;
+    result->hash = machine_hash(machine);
+
+    // only build the observation once per step, after the skipped frames
+    if (env->obs_type == ENV_OBS_GRAY)
+    {
+        build_gray(env);
+        result->observation = env->gray;
+    }
+    else
+    {
+        result->observation = &machine->memory[0x2400];
+    }
+    return ran;
+}
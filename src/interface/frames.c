@@ -0,0 +1,56 @@
+#include <string.h>
+
+#include "frames.h"
+
+void frames_init(FrameBuffer *frames)
+{
+    memset(frames->frame, 0, sizeof(frames->frame));
+    frames->back = 0;
+    atomic_init(&frames->middle, 1);
+    frames->front = 2;
+    memset(frames->carry, 0, sizeof(frames->carry));
+}
+
+void frames_capture(FrameBuffer *frames, const uint8_t *vram, uint8_t *columns, int x, int width)
+{
+    Frame *frame = &frames->frame[frames->back];
+    memcpy(frame->vram + x * 32, vram + x * 32, width * 32);
+    memcpy(frame->columns + x, columns + x, width);
+    memset(columns + x, 0, width);
+}
+
+void frames_publish(FrameBuffer *frames)
+{
+    Frame *frame = &frames->frame[frames->back];
+
+    // the frame has its own changed columns plus any the reader hasn't
+    // seen. assume the reader took the last frame until the swap says
+    // otherwise.
+    for (int x = 0; x < SCREEN_WIDTH; x++)
+    {
+        uint8_t changed = frame->columns[x];
+        frame->columns[x] = changed | frames->carry[x];
+        frames->carry[x] = changed;
+    }
+
+    int old = atomic_exchange_explicit(&frames->middle, frames->back | FRAME_FRESH, memory_order_acq_rel);
+    frames->back = old & ~FRAME_FRESH;
+
+    // the reader missed the last frame, so it needs everything in this one
+    if (old & FRAME_FRESH)
+    {
+        memcpy(frames->carry, frame->columns, SCREEN_WIDTH);
+    }
+}
+
+Frame *frames_take(FrameBuffer *frames)
+{
+    if (!(atomic_load_explicit(&frames->middle, memory_order_acquire) & FRAME_FRESH))
+    {
+        return NULL;
+    }
+    // only the reader clears FRAME_FRESH, so the slot is still fresh here
+    int old = atomic_exchange_explicit(&frames->middle, frames->front, memory_order_acq_rel);
+    frames->front = old & ~FRAME_FRESH;
+    return &frames->frame[frames->front];
+}
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "controls.h"
+#include "games.h"
+#include "interrupts.h"
+#include "latency.h"
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// move the press on from stage from to stage to, unless another thread
+// already did (gave it up)
+static int advance(Latency *latency, int from, int to)
+{
+    return atomic_compare_exchange_strong(&latency->state, &from, to);
+}
+
+// the machine's input hook: the game reading the bit of the press being
+// followed, after the press, is its read. the machine is copied there, and
+// the copy gets the key back as it was.
+static void followed_read(SpaceInvadersMachine *machine, uint8_t port, void *data)
+{
+    Latency *latency = data;
+    if (atomic_load(&latency->state) != LATENCY_EVENT)
+    {
+        return;
+    }
+    const GameInfo *game = &games[machine->game];
+    if (game->in[port] != game->key[latency->key].input ||
+        (int)((machine->keys_applied >> latency->key) & 1) != latency->down)
+    {
+        return;
+    }
+
+    // the copy runs the IN again, and reads the port without the press
+    MachineSnapshot *snapshot = machine_snapshot(machine);
+    if (snapshot == NULL)
+    {
+        advance(latency, LATENCY_EVENT, LATENCY_IDLE);
+        return;
+    }
+    SpaceInvadersMachine *shadow = latency->shadow;
+    machine_restore(shadow, snapshot);
+    snapshot_destroy(snapshot);
+    (latency->down ? key_up : key_down)(shadow, latency->key);
+
+    latency->read_ns = now_ns();
+    latency->read_cycles = machine_cycles(machine);
+    latency->interrupts = 0;
+    advance(latency, LATENCY_EVENT, LATENCY_READ);
+}
+
+int latency_init(Latency *latency, SpaceInvadersMachine *machine)
+{
+    memset(latency, 0, sizeof(Latency));
+    latency->machine = machine;
+    latency->shadow = machine_create();
+    if (latency->shadow == NULL)
+    {
+        return -1;
+    }
+    atomic_init(&latency->state, LATENCY_IDLE);
+    machine->input_hook = followed_read;
+    machine->input_hook_data = latency;
+    return 0;
+}
+
+void latency_key(Latency *latency, uint8_t key, int down)
+{
+    if (key >= NUM_KEYS || games[latency->machine->game].key[key].input == IN_NONE)
+    {
+        return;
+    }
+    long long now = now_ns();
+    int state = atomic_load(&latency->state);
+
+    // the emulation thread gives up on a press that never changes the
+    // screen, this one on a press that is never read or presented
+    if ((state == LATENCY_EVENT || state == LATENCY_VRAM) && now - latency->event_ns > LATENCY_TIMEOUT_NS &&
+        advance(latency, state, LATENCY_IDLE))
+    {
+        latency->lost++;
+        state = LATENCY_IDLE;
+    }
+    if (state != LATENCY_IDLE)
+    {
+        latency->busy++;
+        return;
+    }
+    latency->key = key;
+    latency->down = down != 0;
+    latency->event_ns = now;
+    atomic_store(&latency->state, LATENCY_EVENT);
+}
+
+void latency_interrupt(Latency *latency)
+{
+    if (atomic_load(&latency->state) != LATENCY_READ)
+    {
+        return;
+    }
+
+    // the copy catches up to the interrupt the game is at
+    SpaceInvadersMachine *shadow = latency->shadow;
+    run_to_interrupt(shadow);
+    if (memcmp(latency->machine->memory + VRAM_START, shadow->memory + VRAM_START, RAM_END - VRAM_START) != 0)
+    {
+        latency->vram_ns = now_ns();
+        latency->vram_cycles = machine_cycles(latency->machine);
+        advance(latency, LATENCY_READ, LATENCY_VRAM);
+    }
+    else if (++latency->interrupts >= LATENCY_MAX_INTERRUPTS && advance(latency, LATENCY_READ, LATENCY_IDLE))
+    {
+        latency->unseen++;
+    }
+}
+
+void latency_present(Latency *latency, uint64_t cycles)
+{
+    if (atomic_load(&latency->state) != LATENCY_VRAM || cycles < latency->vram_cycles)
+    {
+        return;
+    }
+    long long now = now_ns();
+    if (latency->count == latency->capacity)
+    {
+        int capacity = latency->capacity ? 2 * latency->capacity : 256;
+        for (int i = 0; i < 4; i++)
+        {
+            long long *span = realloc(latency->span[i], capacity * sizeof(long long));
+            if (span == NULL)
+            {
+                return;
+            }
+            latency->span[i] = span;
+        }
+        latency->capacity = capacity;
+    }
+    int n = latency->count++;
+    latency->span[0][n] = latency->read_ns - latency->event_ns;
+    latency->span[1][n] = latency->vram_ns - latency->read_ns;
+    latency->span[2][n] = now - latency->vram_ns;
+    latency->span[3][n] = now - latency->event_ns;
+    advance(latency, LATENCY_VRAM, LATENCY_IDLE);
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank
+static double percentile_ms(const long long *sorted, int count, int p)
+{
+    int rank = (p * count + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0] / 1e6;
+}
+
+void latency_report(const Latency *latency)
+{
+    static const char *names[4] = {"key to read", "read to screen", "screen to present", "key to present"};
+    printf("     latency of %d key presses (%d changed nothing on screen, %d timed out, %d came during "
+           "another):\n",
+           latency->count, latency->unseen, latency->lost, latency->busy);
+    if (latency->count == 0)
+    {
+        return;
+    }
+    long long *sorted = malloc(latency->count * sizeof(long long));
+    if (sorted == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        memcpy(sorted, latency->span[i], latency->count * sizeof(long long));
+        qsort(sorted, latency->count, sizeof(long long), compare_ns);
+        printf("     %-18s p50 %7.2f ms  p95 %7.2f ms  p99 %7.2f ms\n", names[i],
+               percentile_ms(sorted, latency->count, 50), percentile_ms(sorted, latency->count, 95),
+               percentile_ms(sorted, latency->count, 99));
+    }
+    free(sorted);
+}
+
+void latency_free(Latency *latency)
+{
+    latency->machine->input_hook = NULL;
+    latency->machine->input_hook_data = NULL;
+    machine_destroy(latency->shadow);
+    for (int i = 0; i < 4; i++)
+    {
+        free(latency->span[i]);
+    }
+}
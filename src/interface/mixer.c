@@ -0,0 +1,408 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bank.h"
+#include "mixer.h"
+#include "synth.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+enum mixer_ops
+{
+    MIX_PLAY,
+    MIX_LOOP,
+    MIX_STOP,
+    MIX_MARK,
+    MIX_PORT
+};
+
+typedef struct MixerCommand
+{
+    uint64_t at; // emulated time in samples
+    uint8_t op;
+    uint8_t sound; // or the port for MIX_PORT
+    uint8_t value; // MIX_PORT only
+} MixerCommand;
+
+typedef struct MixerSound
+{
+    const int16_t *data;
+    int length;
+    int16_t *copy; // data if mixer_load made it, NULL if it is in the bank
+} MixerSound;
+
+typedef struct MixerVoice
+{
+    int sound; // -1 when the voice is free
+    int pos;
+    int loop;
+} MixerVoice;
+
+// the queue is a single producer, single consumer ring: only the emulation
+// thread moves head and only the audio thread moves tail.
+struct Mixer
+{
+    MixerSound bank[MIX_SOUNDS];
+    SoundBank file; // mapped by mixer_load_bank
+    MixerVoice voice[MIX_VOICES];
+    Synth synth;
+
+    MixerCommand queue[MIX_QUEUE];
+    atomic_uint head;
+    atomic_uint tail;
+
+    // audio thread only: samples mixed so far, and what to add to an
+    // emulated time to get the output sample it plays at
+    int64_t position;
+    int64_t offset;
+    int synced; // offset is set
+    atomic_llong played; // position - offset, for the emulation thread
+
+    // emulation thread only: how far emulated time is ahead of the output,
+    // smoothed over a few frames
+    int64_t lead;
+    int leading; // lead is set
+};
+
+Mixer *mixer_create(void)
+{
+    Mixer *mixer = calloc(1, sizeof(Mixer));
+    if (mixer == NULL)
+    {
+        return NULL;
+    }
+    for (int v = 0; v < MIX_VOICES; v++)
+    {
+        mixer->voice[v].sound = -1;
+    }
+    atomic_init(&mixer->head, 0);
+    atomic_init(&mixer->tail, 0);
+    atomic_init(&mixer->played, -1);
+    synth_init(&mixer->synth);
+    return mixer;
+}
+
+void mixer_destroy(Mixer *mixer)
+{
+    if (mixer == NULL)
+    {
+        return;
+    }
+    for (int s = 0; s < MIX_SOUNDS; s++)
+    {
+        free(mixer->bank[s].copy);
+    }
+    bank_close(&mixer->file);
+    free(mixer);
+}
+
+int mixer_load(Mixer *mixer, int sound, const int16_t *samples, int length)
+{
+    if (sound < 0 || sound >= MIX_SOUNDS || length <= 0)
+    {
+        return -1;
+    }
+    int16_t *data = malloc(length * sizeof(int16_t));
+    if (data == NULL)
+    {
+        return -1;
+    }
+    memcpy(data, samples, length * sizeof(int16_t));
+    free(mixer->bank[sound].copy);
+    mixer->bank[sound] = (MixerSound){data, length, data};
+    return 0;
+}
+
+int mixer_load_bank(Mixer *mixer, const char *path)
+{
+    if (mixer->file.map != NULL || bank_open(&mixer->file, path) < 0)
+    {
+        return -1;
+    }
+    // played where they are, nothing is copied
+    int loaded = 0;
+    for (int s = 0; s < MIX_SOUNDS; s++)
+    {
+        int length;
+        const int16_t *data = bank_sound(&mixer->file, s, &length);
+        if (data != NULL)
+        {
+            free(mixer->bank[s].copy);
+            mixer->bank[s] = (MixerSound){data, length, NULL};
+            loaded++;
+        }
+    }
+    return loaded;
+}
+
+static int push_command(Mixer *mixer, int op, int sound, uint8_t value, uint64_t at)
+{
+    if (op < MIX_MARK && (sound < 0 || sound >= MIX_SOUNDS))
+    {
+        return -1;
+    }
+    unsigned int head = atomic_load_explicit(&mixer->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&mixer->tail, memory_order_acquire);
+    if (head - tail == MIX_QUEUE)
+    {
+        return -1;
+    }
+    mixer->queue[head % MIX_QUEUE] = (MixerCommand){at, op, sound, value};
+    atomic_store_explicit(&mixer->head, head + 1, memory_order_release);
+    return 0;
+}
+
+int mixer_play(Mixer *mixer, int sound, int loop, uint64_t at)
+{
+    return push_command(mixer, loop ? MIX_LOOP : MIX_PLAY, sound, 0, at);
+}
+
+int mixer_stop(Mixer *mixer, int sound, uint64_t at)
+{
+    return push_command(mixer, MIX_STOP, sound, 0, at);
+}
+
+int mixer_port(Mixer *mixer, int port, uint8_t value, uint64_t at)
+{
+    return push_command(mixer, MIX_PORT, port, value, at);
+}
+
+int mixer_mark(Mixer *mixer, uint64_t at)
+{
+    return push_command(mixer, MIX_MARK, 0, 0, at);
+}
+
+int64_t mixer_played(Mixer *mixer)
+{
+    return atomic_load_explicit(&mixer->played, memory_order_acquire);
+}
+
+long long mixer_pace(Mixer *mixer, uint64_t at, long long frame_ns)
+{
+    int64_t played = mixer_played(mixer);
+    if (played < 0)
+    {
+        return frame_ns;
+    }
+    // the output moves a whole audio buffer at a time, so a single reading
+    // is off by up to a buffer. an average of the last 16 or so isn't.
+    int64_t lead = (int64_t)at - played;
+    if (!mixer->leading)
+    {
+        mixer->lead = lead;
+        mixer->leading = 1;
+    }
+    mixer->lead += (lead - mixer->lead) / 16;
+
+    // ahead of the output: the emulation is fast, make the frame longer
+    int64_t error = mixer->lead - MIX_LATENCY;
+    if (error > MIX_PACE_RANGE)
+    {
+        error = MIX_PACE_RANGE;
+    }
+    else if (error < -MIX_PACE_RANGE)
+    {
+        error = -MIX_PACE_RANGE;
+    }
+    return frame_ns + frame_ns * error * MIX_PACE_PPM / (MIX_PACE_RANGE * 1000000LL);
+}
+
+// start a sound on a free voice, or on the one that has played longest
+static void start_voice(Mixer *mixer, int sound, int loop)
+{
+    if (mixer->bank[sound].data == NULL)
+    {
+        return;
+    }
+    MixerVoice *voice = &mixer->voice[0];
+    for (int v = 0; v < MIX_VOICES; v++)
+    {
+        if (mixer->voice[v].sound < 0)
+        {
+            voice = &mixer->voice[v];
+            break;
+        }
+        if (mixer->voice[v].pos > voice->pos)
+        {
+            voice = &mixer->voice[v];
+        }
+    }
+    voice->sound = sound;
+    voice->pos = 0;
+    voice->loop = loop;
+}
+
+static void apply_command(Mixer *mixer, MixerCommand command)
+{
+    if (command.op == MIX_MARK)
+    {
+        return;
+    }
+    if (command.op == MIX_PORT)
+    {
+        synth_port(&mixer->synth, command.sound, command.value);
+        return;
+    }
+    if (command.op == MIX_STOP)
+    {
+        // only the voices playing this sound, the others carry on
+        for (int v = 0; v < MIX_VOICES; v++)
+        {
+            if (mixer->voice[v].sound == command.sound)
+            {
+                mixer->voice[v].sound = -1;
+            }
+        }
+    }
+    else
+    {
+        start_voice(mixer, command.sound, command.op == MIX_LOOP);
+    }
+}
+
+// output sample the next queued command is due at, or INT64_MAX if none is
+// queued. now is the next sample to be mixed.
+static int64_t next_command(Mixer *mixer, int64_t now)
+{
+    unsigned int tail = atomic_load_explicit(&mixer->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&mixer->head, memory_order_acquire);
+    if (tail == head)
+    {
+        return INT64_MAX;
+    }
+    int64_t at = mixer->queue[tail % MIX_QUEUE].at;
+    int64_t due = at + mixer->offset;
+    if (!mixer->synced || due < now - MIX_LATENCY || due > now + MIX_RESYNC)
+    {
+        mixer->offset = now + MIX_LATENCY - at;
+        mixer->synced = 1;
+        due = now + MIX_LATENCY;
+    }
+    return due;
+}
+
+static void pop_command(Mixer *mixer)
+{
+    unsigned int tail = atomic_load_explicit(&mixer->tail, memory_order_relaxed);
+    apply_command(mixer, mixer->queue[tail % MIX_QUEUE]);
+    atomic_store_explicit(&mixer->tail, tail + 1, memory_order_release);
+}
+
+static inline int16_t add_clamped(int16_t a, int16_t b)
+{
+    int sum = a + b;
+    return sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : sum;
+}
+
+static void mix_scalar(int16_t *out, const int16_t *samples, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = add_clamped(out[i], samples[i]);
+    }
+}
+
+#ifdef __x86_64__
+// eight samples per saturating add
+static void mix_sse2(int16_t *out, const int16_t *samples, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(out + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(samples + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_adds_epi16(a, b));
+    }
+    mix_scalar(out + i, samples + i, count - i);
+}
+#endif
+
+typedef void (*MixFn)(int16_t *, const int16_t *, int);
+typedef int (*SynthFn)(Synth *, int16_t *, int);
+
+// add count samples of every playing voice and of the synthesizer to out
+static void mix_voices(Mixer *mixer, int16_t *out, int count, MixFn mix, SynthFn synth)
+{
+    int16_t block[256];
+    for (int done = 0; done < count; done += 256)
+    {
+        int n = count - done < 256 ? count - done : 256;
+        if (synth(&mixer->synth, block, n))
+        {
+            mix(out + done, block, n);
+        }
+    }
+
+    for (int v = 0; v < MIX_VOICES; v++)
+    {
+        MixerVoice *voice = &mixer->voice[v];
+        int done = 0;
+        while (voice->sound >= 0 && done < count)
+        {
+            const MixerSound *sound = &mixer->bank[voice->sound];
+            int n = sound->length - voice->pos;
+            if (n > count - done)
+            {
+                n = count - done;
+            }
+            mix(out + done, sound->data + voice->pos, n);
+            done += n;
+            voice->pos += n;
+            if (voice->pos == sound->length)
+            {
+                voice->pos = 0;
+                if (!voice->loop)
+                {
+                    voice->sound = -1;
+                }
+            }
+        }
+    }
+}
+
+// mix the buffer in pieces, split at the samples commands are due at
+static void render(Mixer *mixer, int16_t *out, int frames, MixFn mix, SynthFn synth)
+{
+    memset(out, 0, frames * sizeof(int16_t));
+    int done = 0;
+    while (done < frames)
+    {
+        int64_t now = mixer->position + done;
+        int64_t due = next_command(mixer, now);
+        if (due <= now)
+        {
+            pop_command(mixer);
+            continue;
+        }
+        int count = due - now < frames - done ? due - now : frames - done;
+        mix_voices(mixer, out + done, count, mix, synth);
+        done += count;
+    }
+    mixer->position += frames;
+    atomic_store_explicit(&mixer->played, mixer->synced ? mixer->position - mixer->offset : -1,
+                          memory_order_release);
+}
+
+void mixer_render(Mixer *mixer, int16_t *out, int frames)
+{
+#ifdef __x86_64__
+    // sse2 is part of x86-64, no need to check for it
+    render(mixer, out, frames, mix_sse2, synth_render);
+#else
+    render(mixer, out, frames, mix_scalar, synth_render);
+#endif
+}
+
+void mixer_sync(Mixer *mixer, uint64_t at)
+{
+    mixer->offset = mixer->position - (int64_t)at;
+    mixer->synced = 1;
+}
+
+void mixer_render_scalar(Mixer *mixer, int16_t *out, int frames)
+{
+    render(mixer, out, frames, mix_scalar, synth_render_scalar);
+}
@@ -0,0 +1,40 @@
+#include "overlay.h"
+#include "memory.h"
+#include "video.h"
+
+#define WHITE 0xffffffff
+#define RED 0xffff0000
+#define GREEN 0xff00ff00
+#define MAGENTA 0xffff00ff
+
+// Space Invaders: red over the flying saucer, green over the shields and
+// the player's cannon. Lunar Rescue and Balloon Bomber have no overlay
+// here to copy, these just follow where they draw the mothership or
+// balloons and the ground. unused strips are all zero.
+static const OverlayStrip overlays[NUM_GAMES][MAX_STRIPS] = {
+    [GAME_INVADERS] = {{32, 63, RED}, {184, 239, GREEN}},
+    [GAME_INVADERS_DX] = {{32, 63, RED}, {184, 239, GREEN}},
+    [GAME_LRESCUE] = {{24, 63, MAGENTA}, {184, 239, GREEN}},
+    [GAME_BALLOON] = {{32, 63, RED}, {208, 239, GREEN}},
+};
+
+void overlay_rows(uint32_t *row_color, int game)
+{
+    for (int r = 0; r < SCREEN_HEIGHT; r++)
+    {
+        row_color[r] = WHITE;
+    }
+    if (game < 0 || game >= NUM_GAMES)
+    {
+        return;
+    }
+
+    for (int i = 0; i < MAX_STRIPS && overlays[game][i].color; i++)
+    {
+        const OverlayStrip *strip = &overlays[game][i];
+        for (int y = strip->top; y <= strip->bottom; y++)
+        {
+            row_color[SCREEN_HEIGHT - 1 - y] = strip->color;
+        }
+    }
+}
@@ -0,0 +1,265 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+#include "interrupts.h"
+#include "overlay.h"
+#include "shots.h"
+#include "video.h"
+
+typedef struct Shot
+{
+    int frame;
+    uint8_t vram[VRAM_SIZE];
+} Shot;
+
+// ring of queued frames. the emulation adds at head, the writer thread
+// takes from tail and only frees the slot once the frame is written.
+struct ShotWriter
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // a frame was queued or written, or stop was set
+    Shot queue[SHOT_QUEUE];
+    int head;
+    int count;
+    int stop;
+
+    char prefix[256];
+    int format;
+    int scale;
+    uint32_t row_color[SCREEN_HEIGHT];
+    uint32_t *pixels;
+    int failed;
+
+    // SHOT_Y4M only
+    FILE *stream;
+    uint8_t *planes;
+};
+
+// BT.601 studio-swing YUV of a colour
+static void rgb_to_yuv(uint32_t color, uint8_t *y, uint8_t *u, uint8_t *v)
+{
+    int r = (color >> 16) & 0xff, g = (color >> 8) & 0xff, b = color & 0xff;
+    *y = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    *u = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    *v = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+// append one frame to the YUV4MPEG2 stream, as three full size planes
+static int write_frame(ShotWriter *writer, int width, int height)
+{
+    int size = width * height;
+    uint8_t *y = writer->planes, *u = y + size, *v = u + size;
+    uint32_t last = 0;
+    uint8_t ly, lu, lv;
+    rgb_to_yuv(last, &ly, &lu, &lv);
+    for (int i = 0; i < size; i++)
+    {
+        // the screen has a handful of colours, convert each only once per run
+        if (writer->pixels[i] != last)
+        {
+            last = writer->pixels[i];
+            rgb_to_yuv(last, &ly, &lu, &lv);
+        }
+        y[i] = ly;
+        u[i] = lu;
+        v[i] = lv;
+    }
+    fputs("FRAME\n", writer->stream);
+    if (fwrite(writer->planes, 3, size, writer->stream) != (size_t)size)
+    {
+        fprintf(stderr, "unable to write the video stream %s\n", writer->prefix);
+        return -1;
+    }
+    return 0;
+}
+
+static int write_shot(ShotWriter *writer, const Shot *shot)
+{
+    int width = SCREEN_WIDTH * writer->scale;
+    int height = SCREEN_HEIGHT * writer->scale;
+    video_render(writer->pixels, width * sizeof(uint32_t), shot->vram, writer->row_color, writer->scale);
+
+    char path[300];
+    switch (writer->format)
+    {
+    case SHOT_PPM:
+        snprintf(path, sizeof(path), "%s%06d.ppm", writer->prefix, shot->frame);
+        return image_write_ppm(path, writer->pixels, width, height);
+    case SHOT_PNG:
+        snprintf(path, sizeof(path), "%s%06d.png", writer->prefix, shot->frame);
+        return image_write_png(path, writer->pixels, width, height);
+    default:
+        // once the stream breaks (e.g. the encoder reading it quit) every
+        // frame after it is lost too
+        return writer->failed > 0 ? -1 : write_frame(writer, width, height);
+    }
+}
+
+static void *write_shots(void *data)
+{
+    ShotWriter *writer = data;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;)
+    {
+        while (writer->count == 0 && !writer->stop)
+        {
+            pthread_cond_wait(&writer->changed, &writer->lock);
+        }
+        if (writer->count == 0)
+        {
+            break;
+        }
+        Shot *shot = &writer->queue[(writer->head - writer->count + SHOT_QUEUE) % SHOT_QUEUE];
+        pthread_mutex_unlock(&writer->lock);
+
+        int result = write_shot(writer, shot);
+
+        pthread_mutex_lock(&writer->lock);
+        writer->failed += result < 0;
+        writer->count--;
+        pthread_cond_broadcast(&writer->changed);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+// returns -1 if the end of the stream could not be written
+static int close_stream(ShotWriter *writer)
+{
+    int result = 0;
+    if (writer->stream != NULL)
+    {
+        result = writer->stream == stdout ? fflush(stdout) : fclose(writer->stream);
+    }
+    writer->stream = NULL;
+    free(writer->planes);
+    writer->planes = NULL;
+    return result != 0 ? -1 : 0;
+}
+
+// open the video stream (- is stdout) and write its header. the planes are
+// full size (4:4:4), so one pixel wide sprites keep their colour.
+static int open_stream(ShotWriter *writer)
+{
+    int width = SCREEN_WIDTH * writer->scale;
+    int height = SCREEN_HEIGHT * writer->scale;
+    writer->planes = malloc((size_t)width * height * 3);
+    writer->stream = strcmp(writer->prefix, "-") == 0 ? stdout : fopen(writer->prefix, "wb");
+    if (writer->planes == NULL || writer->stream == NULL)
+    {
+        fprintf(stderr, "unable to open the video stream %s\n", writer->prefix);
+        close_stream(writer);
+        return -1;
+    }
+    fprintf(writer->stream, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444\n", width, height, CPU_CLOCK, FRAME_CYCLES);
+    return 0;
+}
+
+ShotWriter *shots_start(const char *prefix, int format, int game, int scale)
+{
+    ShotWriter *writer = calloc(1, sizeof(ShotWriter));
+    if (writer == NULL)
+    {
+        return NULL;
+    }
+    writer->pixels = malloc((size_t)SCREEN_WIDTH * SCREEN_HEIGHT * scale * scale * sizeof(uint32_t));
+    if (writer->pixels == NULL)
+    {
+        free(writer);
+        return NULL;
+    }
+    snprintf(writer->prefix, sizeof(writer->prefix), "%s", prefix);
+    writer->format = format;
+    writer->scale = scale;
+    overlay_rows(writer->row_color, game);
+
+    // pick the video kernel here rather than racing for it on the thread
+    video_kernel();
+
+    if (format == SHOT_Y4M && open_stream(writer) < 0)
+    {
+        free(writer->pixels);
+        free(writer);
+        return NULL;
+    }
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->changed, NULL);
+    if (pthread_create(&writer->thread, NULL, write_shots, writer) != 0)
+    {
+        fprintf(stderr, "unable to start the screenshot thread\n");
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->changed);
+        close_stream(writer);
+        free(writer->pixels);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+// copy a frame into the free slot at head and hand it to the writer.
+// called with the lock held, returns with it released.
+static void add_shot(ShotWriter *writer, int frame, const uint8_t *vram)
+{
+    Shot *shot = &writer->queue[writer->head];
+    pthread_mutex_unlock(&writer->lock);
+
+    // the writer never touches a free slot, so it can be filled unlocked
+    shot->frame = frame;
+    memcpy(shot->vram, vram, VRAM_SIZE);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->head = (writer->head + 1) % SHOT_QUEUE;
+    writer->count++;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void shots_queue(ShotWriter *writer, int frame, const uint8_t *vram)
+{
+    pthread_mutex_lock(&writer->lock);
+    while (writer->count == SHOT_QUEUE)
+    {
+        pthread_cond_wait(&writer->changed, &writer->lock);
+    }
+    add_shot(writer, frame, vram);
+}
+
+int shots_try_queue(ShotWriter *writer, int frame, const uint8_t *vram)
+{
+    pthread_mutex_lock(&writer->lock);
+    if (writer->count == SHOT_QUEUE)
+    {
+        pthread_mutex_unlock(&writer->lock);
+        return -1;
+    }
+    add_shot(writer, frame, vram);
+    return 0;
+}
+
+int shots_finish(ShotWriter *writer)
+{
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = 1;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    int failed = writer->failed;
+    if (close_stream(writer) < 0 && failed == 0)
+    {
+        fprintf(stderr, "unable to write the video stream %s\n", writer->prefix);
+        failed = 1;
+    }
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->changed);
+    free(writer->pixels);
+    free(writer);
+    return failed;
+}
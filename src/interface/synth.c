@@ -0,0 +1,303 @@
+#include <string.h>
+
+#include "mixer.h"
+#include "synth.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+// the sounds, one per lane. from computerarchaeology:
+// port 3 bit 0 ufo (repeats), bit 1 shot, bit 2 flash (player die),
+// bit 3 invader die, bit 4 extended play, bit 5 amp enable.
+// port 5 bits 0-3 fleet movement 1-4, bit 4 ufo hit.
+enum synth_channels
+{
+    CH_UFO,
+    CH_SHOT,
+    CH_FLASH,
+    CH_INVADER,
+    CH_FLEET,
+    CH_UFO_HIT,
+    CH_BONUS
+};
+
+// phase step of a square wave of f Hz
+#define HZ(f) ((f) * 65536 / MIX_RATE)
+
+// the two levels of the square wave and the noise
+#define HIGH 16383
+#define LOW (-16384)
+
+// the lanes are summed at 32768ths of their levels, times 4 to come out
+// about as loud as the samples
+#define OUT_SHIFT 13
+
+// fleet movement, from the first note down to the fourth
+static const int fleet_hz[4] = {110, 98, 87, 78};
+
+void synth_init(Synth *synth)
+{
+    memset(synth, 0, sizeof(Synth));
+    synth->lfsr = 1;
+    synth->silent = 1;
+}
+
+static void start(SynthChannel *channel)
+{
+    channel->age = 0;
+    channel->env = 32767;
+}
+
+void synth_port(Synth *synth, int port, uint8_t value)
+{
+    // the new envelopes take effect from this very sample
+    synth->countdown = 0;
+    SynthChannel *channel = synth->channel;
+    if (port == 3)
+    {
+        uint8_t on = value & ~synth->port3;
+        channel[CH_UFO].gate = value & 0x1;
+        channel[CH_FLASH].gate = value & 0x4;
+        channel[CH_BONUS].gate = value & 0x10;
+        if (on & 0x1)
+        {
+            channel[CH_UFO].age = 0;
+        }
+        if (on & 0x2)
+        {
+            start(&channel[CH_SHOT]);
+        }
+        if (on & 0x4)
+        {
+            start(&channel[CH_FLASH]);
+        }
+        if (on & 0x8)
+        {
+            start(&channel[CH_INVADER]);
+        }
+        if (on & 0x10)
+        {
+            channel[CH_BONUS].age = 0;
+        }
+        synth->port3 = value;
+    }
+    else if (port == 5)
+    {
+        uint8_t on = value & ~synth->port5;
+        for (int note = 0; note < 4; note++)
+        {
+            if (on & 1 << note)
+            {
+                start(&channel[CH_FLEET]);
+                channel[CH_FLEET].note = note;
+            }
+        }
+        channel[CH_UFO_HIT].gate = value & 0x10;
+        if (on & 0x10)
+        {
+            channel[CH_UFO_HIT].age = 0;
+        }
+        synth->port5 = value;
+    }
+}
+
+static int decay(int env, int factor)
+{
+    return env * factor >> 15;
+}
+
+// a sound that lasts while its bit is set: rise quickly when it goes on,
+// fall away at factor per step when it goes off
+static int hold(const SynthChannel *channel, int factor)
+{
+    return channel->gate ? channel->env + (32767 - channel->env) / 4 : decay(channel->env, factor);
+}
+
+static void set_lane(Synth *synth, int lane, int hz, int tone, int noise, int cutoff, int gain)
+{
+    int amp = synth->port3 & 0x20;
+    synth->step[lane] = HZ(hz);
+    synth->tone[lane] = tone;
+    synth->noise[lane] = noise;
+    synth->cutoff[lane] = cutoff;
+    synth->level[lane] = amp ? synth->channel[lane].env * gain >> 15 : 0;
+}
+
+// move the envelopes and pitches on by a step
+static void update(Synth *synth)
+{
+    SynthChannel *channel = synth->channel;
+
+    // ufo: a square wave warbling between 400 and 816 Hz about 6.6 times
+    // a second, for as long as the ufo is on screen
+    SynthChannel *ufo = &channel[CH_UFO];
+    ufo->env = hold(ufo, 27000);
+    int warble = ufo->age % 104;
+    warble = warble < 52 ? warble : 104 - warble;
+    set_lane(synth, CH_UFO, 400 + warble * 8, 32767, 0, 8000, 4000);
+
+    // shot: a falling tone over a hiss, a third of a second long
+    SynthChannel *shot = &channel[CH_SHOT];
+    shot->env = decay(shot->env, 32276);
+    int pitch = 1500 - shot->age * 6;
+    set_lane(synth, CH_SHOT, pitch > 150 ? pitch : 150, 20000, 12000, 16000, 6000);
+
+    // player explosion: low rumbling noise while the bit is set
+    SynthChannel *flash = &channel[CH_FLASH];
+    flash->env = hold(flash, 31457);
+    set_lane(synth, CH_FLASH, 45, 6000, 32767, 4000, 8191);
+
+    // invader explosion: a short burst of noise with a dropping thud
+    SynthChannel *invader = &channel[CH_INVADER];
+    invader->env = decay(invader->env, 30474);
+    pitch = 300 - invader->age * 4;
+    set_lane(synth, CH_INVADER, pitch > 60 ? pitch : 60, 8000, 32767, 12000, 6000);
+
+    // fleet movement: a soft low thump, one of four notes
+    SynthChannel *fleet = &channel[CH_FLEET];
+    fleet->env = decay(fleet->env, 30474);
+    set_lane(synth, CH_FLEET, fleet_hz[fleet->note], 32767, 0, 2500, 8191);
+
+    // ufo hit: a fast repeating downward sweep while the bit is set
+    SynthChannel *hit = &channel[CH_UFO_HIT];
+    hit->env = hold(hit, 27853);
+    set_lane(synth, CH_UFO_HIT, 1800 - hit->age % 24 * 50, 32767, 0, 12000, 5000);
+
+    // extended play: a beeping tone while the bit is set
+    SynthChannel *bonus = &channel[CH_BONUS];
+    bonus->env = bonus->gate ? (bonus->age / 10 % 2 ? 0 : 32767) : decay(bonus->env, 26214);
+    set_lane(synth, CH_BONUS, 1200, 32767, 0, 16000, 5000);
+
+    synth->silent = 1;
+    for (int lane = 0; lane < SYNTH_LANES; lane++)
+    {
+        synth->silent &= synth->level[lane] == 0;
+        if (channel[lane].age < 1 << 30)
+        {
+            channel[lane].age++;
+        }
+    }
+}
+
+static inline int16_t next_noise(Synth *synth)
+{
+    int bit = synth->lfsr & 1;
+    synth->lfsr >>= 1;
+    if (bit)
+    {
+        synth->lfsr ^= 0xb400;
+    }
+    return bit ? HIGH : LOW;
+}
+
+// the high half of a 16 by 16 bit product, like _mm_mulhi_epi16
+static inline int16_t mulhi(int16_t a, int16_t b)
+{
+    return (int32_t)a * b >> 16;
+}
+
+static inline int16_t clamp16(int32_t sample)
+{
+    return sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : sample;
+}
+
+static void lanes_scalar(Synth *synth, int16_t *out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int16_t noise = next_noise(synth);
+        int32_t sum = 0;
+        for (int lane = 0; lane < SYNTH_LANES; lane++)
+        {
+            synth->phase[lane] = (uint16_t)(synth->phase[lane] + synth->step[lane]);
+            int16_t wave = synth->phase[lane] < 0 ? LOW : HIGH;
+            int16_t in = mulhi(wave, synth->tone[lane]) + mulhi(noise, synth->noise[lane]);
+            int16_t error = in - synth->filtered[lane];
+            synth->filtered[lane] += mulhi(error, synth->cutoff[lane]);
+            sum += synth->filtered[lane] * synth->level[lane];
+        }
+        out[i] = clamp16(sum >> OUT_SHIFT);
+    }
+}
+
+#ifdef __x86_64__
+// the eight sounds in the eight lanes, one sample per pass
+static void lanes_sse2(Synth *synth, int16_t *out, int count)
+{
+    __m128i phase = _mm_loadu_si128((const __m128i *)synth->phase);
+    __m128i step = _mm_loadu_si128((const __m128i *)synth->step);
+    __m128i tone = _mm_loadu_si128((const __m128i *)synth->tone);
+    __m128i noise_gain = _mm_loadu_si128((const __m128i *)synth->noise);
+    __m128i cutoff = _mm_loadu_si128((const __m128i *)synth->cutoff);
+    __m128i filtered = _mm_loadu_si128((const __m128i *)synth->filtered);
+    __m128i level = _mm_loadu_si128((const __m128i *)synth->level);
+    __m128i high = _mm_set1_epi16(HIGH);
+    for (int i = 0; i < count; i++)
+    {
+        __m128i noise = _mm_set1_epi16(next_noise(synth));
+        phase = _mm_add_epi16(phase, step);
+        // all ones in the low half, so the xor gives LOW there and HIGH above
+        __m128i wave = _mm_xor_si128(_mm_srai_epi16(phase, 15), high);
+        __m128i in = _mm_add_epi16(_mm_mulhi_epi16(wave, tone), _mm_mulhi_epi16(noise, noise_gain));
+        __m128i error = _mm_sub_epi16(in, filtered);
+        filtered = _mm_add_epi16(filtered, _mm_mulhi_epi16(error, cutoff));
+
+        __m128i sum = _mm_madd_epi16(filtered, level);
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        out[i] = clamp16(_mm_cvtsi128_si32(sum) >> OUT_SHIFT);
+    }
+    _mm_storeu_si128((__m128i *)synth->phase, phase);
+    _mm_storeu_si128((__m128i *)synth->filtered, filtered);
+}
+#endif
+
+typedef void (*LanesFn)(Synth *, int16_t *, int);
+
+static int render(Synth *synth, int16_t *out, int frames, LanesFn lanes)
+{
+    // skip the work while nothing sounds, but keep the steps going so the
+    // envelopes time out the same way
+    int sounding = 0;
+    int done = 0;
+    while (done < frames)
+    {
+        if (synth->countdown == 0)
+        {
+            update(synth);
+            synth->countdown = SYNTH_STEP;
+        }
+        int count = synth->countdown < frames - done ? synth->countdown : frames - done;
+        if (!synth->silent)
+        {
+            if (!sounding)
+            {
+                memset(out, 0, done * sizeof(int16_t));
+                sounding = 1;
+            }
+            lanes(synth, out + done, count);
+        }
+        else if (sounding)
+        {
+            memset(out + done, 0, count * sizeof(int16_t));
+        }
+        synth->countdown -= count;
+        done += count;
+    }
+    return sounding;
+}
+
+int synth_render(Synth *synth, int16_t *out, int frames)
+{
+#ifdef __x86_64__
+    return render(synth, out, frames, lanes_sse2);
+#else
+    return render(synth, out, frames, lanes_scalar);
+#endif
+}
+
+int synth_render_scalar(Synth *synth, int16_t *out, int frames)
+{
+    return render(synth, out, frames, lanes_scalar);
+}
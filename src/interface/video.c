@@ -0,0 +1,301 @@
+#include <string.h>
+
+#include "video.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+// largest scale the vector kernels handle, bigger ones use the scalar code
+#define MAX_SCALE 8
+
+// output row for source row r, counting from the bottom
+static inline uint32_t *out_row(uint32_t *pixels, int pitch, int r, int scale)
+{
+    return (uint32_t *)((uint8_t *)pixels + (SCREEN_HEIGHT * scale - 1 - r * scale) * pitch);
+}
+
+// clear the scale - 1 rows above every drawn row, in columns x0 .. x1 - 1
+static void clear_gaps(uint32_t *pixels, int pitch, int scale, int x0, int x1)
+{
+    for (int r = 0; r < SCREEN_HEIGHT; r++)
+    {
+        uint32_t *row = out_row(pixels, pitch, r, scale) + x0 * scale;
+        for (int k = 1; k < scale; k++)
+        {
+            memset((uint8_t *)row - k * pitch, 0, (x1 - x0) * scale * sizeof(uint32_t));
+        }
+    }
+}
+
+static void render_scalar(uint32_t *pixels, int pitch, const uint8_t *vram, const uint32_t *row_color, int scale,
+                          int x0, int x1)
+{
+    clear_gaps(pixels, pitch, scale, x0, x1);
+    for (int r = 0; r < SCREEN_HEIGHT; r++)
+    {
+        uint32_t *out = out_row(pixels, pitch, r, scale);
+        for (int x = x0; x < x1; x++)
+        {
+            uint32_t pixel = (vram[x * 32 + r / 8] >> (r % 8)) & 1 ? row_color[r] : 0;
+            for (int k = 0; k < scale; k++)
+            {
+                out[x * scale + k] = pixel;
+            }
+        }
+    }
+}
+
+#ifdef __x86_64__
+
+// the vector kernels work on byte rows: byte yb of n neighbouring columns is
+// an n x 8 bit matrix. movemask reads the top bit of every byte at once,
+// and adding the vector to itself moves the next bit up, so 8 movemasks
+// transpose it into 8 output rows of n pixels each.
+
+// byte rows of video memory: rows[yb * 224 + x] is byte yb of column x,
+// for columns x0 .. x1 - 1 (both multiples of 16).
+// columns are 32 bytes apart in video memory, so they are transposed as
+// 16x16 byte blocks first: four rounds of interleaving the top and bottom
+// halves of a block is a full transpose.
+static void byte_rows(uint8_t *rows, const uint8_t *vram, int x0, int x1)
+{
+    for (int x = x0; x < x1; x += 16)
+    {
+        for (int yb = 0; yb < 32; yb += 16)
+        {
+            __m128i v[16], t[16];
+            for (int i = 0; i < 16; i++)
+            {
+                v[i] = _mm_loadu_si128((const __m128i *)(vram + (x + i) * 32 + yb));
+            }
+            for (int round = 0; round < 4; round++)
+            {
+                for (int i = 0; i < 8; i++)
+                {
+                    t[2 * i] = _mm_unpacklo_epi8(v[i], v[i + 8]);
+                    t[2 * i + 1] = _mm_unpackhi_epi8(v[i], v[i + 8]);
+                }
+                memcpy(v, t, sizeof(v));
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                _mm_storeu_si128((__m128i *)(rows + (yb + i) * SCREEN_WIDTH + x), v[i]);
+            }
+        }
+    }
+}
+
+// 16 pixels from the low bits of bits, scale wide each. sse2 has no
+// variable shuffle, so the repeats are spelled out per scale.
+static inline uint32_t *expand_sse2(uint32_t *out, uint32_t bits, __m128i color, int scale)
+{
+    const __m128i sel = _mm_setr_epi32(1, 2, 4, 8);
+    for (int q = 0; q < 4; q++, bits >>= 4)
+    {
+        __m128i m = _mm_and_si128(_mm_set1_epi32(bits), sel);
+        m = _mm_and_si128(_mm_cmpeq_epi32(m, sel), color);
+        switch (scale)
+        {
+        case 1:
+            _mm_storeu_si128((__m128i *)out, m);
+            break;
+        case 2:
+            _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi32(m, m));
+            _mm_storeu_si128((__m128i *)out + 1, _mm_unpackhi_epi32(m, m));
+            break;
+        case 3:
+            _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi32(m, 0x40));     // a a a b
+            _mm_storeu_si128((__m128i *)out + 1, _mm_shuffle_epi32(m, 0xa5)); // b b c c
+            _mm_storeu_si128((__m128i *)out + 2, _mm_shuffle_epi32(m, 0xfe)); // c d d d
+            break;
+        }
+        out += 4 * scale;
+    }
+    return out;
+}
+
+static void render_sse2(uint32_t *pixels, int pitch, const uint8_t *vram, const uint32_t *row_color, int scale,
+                        int x0, int x1)
+{
+    if (scale > 3)
+    {
+        render_scalar(pixels, pitch, vram, row_color, scale, x0, x1);
+        return;
+    }
+
+    // whole groups of 16 columns. drawing a few more columns than asked
+    // is harmless, they show the same video memory.
+    x0 &= ~15;
+    x1 = (x1 + 15) & ~15;
+
+    uint8_t rows[VRAM_SIZE];
+    byte_rows(rows, vram, x0, x1);
+    clear_gaps(pixels, pitch, scale, x0, x1);
+    for (int yb = 0; yb < 32; yb++)
+    {
+        for (int x = x0; x < x1; x += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(rows + yb * SCREEN_WIDTH + x));
+            for (int bit = 7; bit >= 0; bit--)
+            {
+                int r = yb * 8 + bit;
+                uint32_t *out = out_row(pixels, pitch, r, scale) + x * scale;
+                expand_sse2(out, _mm_movemask_epi8(v), _mm_set1_epi32(row_color[r]), scale);
+                v = _mm_add_epi8(v, v);
+            }
+        }
+    }
+}
+
+// 32 pixels from bits. index[k] picks which of 8 pixels land in the k-th
+// group of 8 outputs, so any scale is one permute per 8 pixels written.
+__attribute__((target("avx2")))
+static inline void expand_avx2(uint32_t *out, uint32_t bits, __m256i color, int scale, const __m256i *index)
+{
+    const __m256i sel = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    for (int q = 0; q < 4; q++, bits >>= 8)
+    {
+        __m256i m = _mm256_and_si256(_mm256_set1_epi32(bits), sel);
+        m = _mm256_and_si256(_mm256_cmpeq_epi32(m, sel), color);
+        if (scale == 1)
+        {
+            _mm256_storeu_si256((__m256i *)out, m);
+            out += 8;
+            continue;
+        }
+        for (int k = 0; k < scale; k++)
+        {
+            _mm256_storeu_si256((__m256i *)out, _mm256_permutevar8x32_epi32(m, index[k]));
+            out += 8;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void render_avx2(uint32_t *pixels, int pitch, const uint8_t *vram, const uint32_t *row_color, int scale,
+                        int x0, int x1)
+{
+    if (scale > MAX_SCALE)
+    {
+        render_scalar(pixels, pitch, vram, row_color, scale, x0, x1);
+        return;
+    }
+
+    __m256i index[MAX_SCALE];
+    for (int k = 0; k < scale; k++)
+    {
+        int lane[8];
+        for (int j = 0; j < 8; j++)
+        {
+            lane[j] = (k * 8 + j) / scale;
+        }
+        index[k] = _mm256_loadu_si256((const __m256i *)lane);
+    }
+
+    // whole groups of 32 columns (224 is a multiple of 32)
+    x0 &= ~31;
+    x1 = (x1 + 31) & ~31;
+
+    uint8_t rows[VRAM_SIZE];
+    byte_rows(rows, vram, x0, x1);
+    clear_gaps(pixels, pitch, scale, x0, x1);
+    for (int yb = 0; yb < 32; yb++)
+    {
+        for (int x = x0; x < x1; x += 32)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(rows + yb * SCREEN_WIDTH + x));
+            for (int bit = 7; bit >= 0; bit--)
+            {
+                int r = yb * 8 + bit;
+                uint32_t *out = out_row(pixels, pitch, r, scale) + x * scale;
+                expand_avx2(out, _mm256_movemask_epi8(v), _mm256_set1_epi32(row_color[r]), scale, index);
+                v = _mm256_add_epi8(v, v);
+            }
+        }
+    }
+}
+
+#endif
+
+typedef void (*RenderFn)(uint32_t *, int, const uint8_t *, const uint32_t *, int, int, int);
+
+static RenderFn kernel;
+static const char *kernel_name;
+
+// choose the best kernel for this CPU, once
+static void pick_kernel(void)
+{
+#ifdef __x86_64__
+    // sse2 is part of x86-64, avx2 has to be asked for
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernel_name = "avx2";
+        kernel = render_avx2;
+    }
+    else
+    {
+        kernel_name = "sse2";
+        kernel = render_sse2;
+    }
+#else
+    kernel_name = "scalar";
+    kernel = render_scalar;
+#endif
+}
+
+void video_render(uint32_t *pixels, int pitch, const uint8_t *vram, const uint32_t *row_color, int scale)
+{
+    video_render_columns(pixels, pitch, vram, row_color, scale, 0, SCREEN_WIDTH);
+}
+
+void video_render_columns(uint32_t *pixels, int pitch, const uint8_t *vram, const uint32_t *row_color, int scale,
+                          int x, int width)
+{
+    if (!kernel)
+    {
+        pick_kernel();
+    }
+    kernel(pixels, pitch, vram, row_color, scale, x, x + width);
+}
+
+void video_render_scalar(uint32_t *pixels, int pitch, const uint8_t *vram, const uint32_t *row_color, int scale)
+{
+    render_scalar(pixels, pitch, vram, row_color, scale, 0, SCREEN_WIDTH);
+}
+
+int video_next_run(uint8_t *columns, int *x)
+{
+    int start = *x;
+    while (start < SCREEN_WIDTH && !columns[start])
+    {
+        start++;
+    }
+    if (start == SCREEN_WIDTH)
+    {
+        return 0;
+    }
+
+    // extend the run while the next dirty column is close enough
+    int end = start + 1;
+    for (int i = end; i < SCREEN_WIDTH && i < end + RUN_GAP; i++)
+    {
+        if (columns[i])
+        {
+            end = i + 1;
+        }
+    }
+    memset(columns + start, 0, end - start);
+    *x = start;
+    return end - start;
+}
+
+const char *video_kernel(void)
+{
+    if (!kernel)
+    {
+        pick_kernel();
+    }
+    return kernel_name;
+}
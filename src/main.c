@@ -1,19 +1,136 @@
 #include <SDL2/SDL.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "controls.h"
 #include "disasm.h"
 #include "display.h"
+#include "frames.h"
 #include "interrupts.h"
+#include "latency.h"
+#include "machine.h"
 #include "memory.h"
+#include "mixer.h"
 #include "ports.h"
 #include "processor.h"
+#include "shots.h"
 #include "sounds.h"
 
+// the emulation runs on its own thread and hands finished frames to the
+// main thread, which handles events and draws. neither waits for the other;
+// both sleep when there is nothing to do.
+static atomic_int running;
+static FrameBuffer frames;
+
+// keys held down, one bit per port_keys value. set by the event loop and
+// read by the emulation thread whenever the game reads its input ports
+// (machine->keys), so the game sees a key the next time it looks rather
+// than at the next interrupt.
+static atomic_uint held_keys;
+
+// --latency: time key presses on their way to the screen
+static int measure_latency = 0;
+static Latency latency;
+
+static void hold_key(uint8_t key)
+{
+    if (measure_latency && !(atomic_load(&held_keys) & (1u << key)))
+    {
+        latency_key(&latency, key, 1);
+    }
+    atomic_fetch_or(&held_keys, 1u << key);
+}
+
+static void release_key(uint8_t key)
+{
+    if (measure_latency && (atomic_load(&held_keys) & (1u << key)))
+    {
+        latency_key(&latency, key, 0);
+    }
+    atomic_fetch_and(&held_keys, ~(1u << key));
+}
+
+// with split_frame set, the part of the screen the beam draws before RST 1
+// is captured at RST 1, like the monitor showed it. otherwise the whole
+// screen is captured at vblank (RST 2).
+static int split_frame = 0;
+
+// pushed by the emulation thread when it publishes a frame, to wake the
+// event loop
+static Uint32 frame_event;
+
+// --audio-pace: time the frames by the sound card's clock, through the
+// mixer, rather than the host's
+static int audio_pace = 0;
+
+// --synth: synthesize the sounds instead of playing the recorded samples
+static int synth = 0;
+
+// --y4m: every frame also goes to a video stream. the game has to keep real
+// time, so frames the writer has no room for are dropped and counted.
+static ShotWriter *video = NULL;
+static int video_frames = 0;
+static int video_dropped = 0;
+
+// emulation thread: run the machine one frame at a time and publish every
+// frame at vblank (RST 2), then sleep until the next one is due. it only
+// uses the cpu for the emulation itself.
+static int emulate(void *data)
+{
+    SpaceInvadersMachine *machine = data;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (running)
+    {
+        // capture the screen exactly when the interrupts fire, before the
+        // game's interrupt code changes it
+        int interrupt = run_to_interrupt(machine);
+        if (measure_latency)
+        {
+            latency_interrupt(&latency);
+        }
+        uint8_t *vram = get_framebuffer(&machine->state);
+        uint8_t *columns = get_dirty_columns(&machine->state);
+        if (interrupt == 1 && split_frame)
+        {
+            frames_capture(&frames, vram, columns, 0, MID_SCREEN_LINE);
+        }
+        else if (interrupt == 2)
+        {
+            int x = split_frame ? MID_SCREEN_LINE : 0;
+            frames_capture(&frames, vram, columns, x, SCREEN_WIDTH - x);
+            if (video != NULL)
+            {
+                video_frames++;
+                video_dropped -= shots_try_queue(video, video_frames, frames.frame[frames.back].vram);
+            }
+            frames.frame[frames.back].cycles = machine_cycles(machine);
+            frames_publish(&frames);
+
+            SDL_Event event = {.type = frame_event};
+            SDL_PushEvent(&event);
+
+            // with no sound device there is no other clock to follow
+            long long frame_ns = FRAME_NS;
+            Mixer *mixer = machine->sound.mixer;
+            if (audio_pace && mixer != NULL)
+            {
+                uint64_t at = machine_cycles(machine) * MIX_RATE / CPU_CLOCK;
+                mixer_mark(mixer, at);
+                frame_ns = mixer_pace(mixer, at, frame_ns);
+            }
+            wait_frame(&deadline, frame_ns);
+        }
+    }
+    return 0;
+}
 
 void printDelay(const char *str) {
     while (*str) {
@@ -26,6 +143,41 @@ void printDelay(const char *str) {
 
 int main(int argc, char **argv)
 {
+    // --split: capture the top of the screen at the mid-screen interrupt
+    // --audio-pace: keep the sound latency fixed on long sessions
+    // --synth: synthesized sounds
+    // --y4m FILE: record every frame to FILE (e.g. a fifo an encoder reads)
+    // --latency: report how long key presses take to reach the screen
+    const char *y4m = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--split") == 0)
+        {
+            split_frame = 1;
+        }
+        else if (strcmp(argv[i], "--audio-pace") == 0)
+        {
+            audio_pace = 1;
+        }
+        else if (strcmp(argv[i], "--synth") == 0)
+        {
+            synth = 1;
+        }
+        else if (strcmp(argv[i], "--latency") == 0)
+        {
+            measure_latency = 1;
+        }
+        else if (strcmp(argv[i], "--y4m") == 0 && i + 1 < argc)
+        {
+            y4m = argv[++i];
+        }
+    }
+    if (y4m != NULL && strcmp(y4m, "-") == 0)
+    {
+        printf("the menu uses stdout, give --y4m a file or a fifo\n");
+        return 1;
+    }
+
     // hide cursor
     printf("\e[?25l");
 
@@ -119,51 +271,30 @@ int main(int argc, char **argv)
 
     printDelay("     Starting game ...\n");
 
-    // initialize memory buffer and load ROM files into memory
-
-    if (gameSelection == 1)
-    {
-        mem_init();
-    }
-    else if (gameSelection == 2)
+    // create a machine - it owns the memory, CPU state, ports and sounds
+    SpaceInvadersMachine *machine = machine_create();
+    if (machine == NULL)
     {
-        mem_init_dx();
+        printDelay("     Could not allocate the machine\n");
+        return 1;
     }
-    else if (gameSelection == 3)
+
+    // initialize memory buffer and load ROM files into memory
+    // anything past the last menu entry picks the last game, like before
+    int game = gameSelection - 1;
+    if (game < GAME_INVADERS || game >= NUM_GAMES)
     {
-        mem_init_lrescue();
+        game = GAME_BALLOON;
     }
-    else 
+    if (mem_init_game(machine, game) < 0)
     {
-        mem_init_balloon();
+        machine_destroy(machine);
+        return 1;
     }
 
-    // set up a State8080 struct
-    State8080 cpu_state;
-
-    // create a machine
-    SpaceInvadersMachine machine;
-
-    // initialize the machine
-    machine.state = &cpu_state;
-    machine.lastTimer = 0;  // set the initial timer value - otherwise the game won't start right away.
-    machine.in_port = 0x00; // set initial port values
-    machine.in_port_2 = 0x00;
-    machine.out_port = 0x00;
-    machine.out_port_3 = 0;
-    machine.out_port_5 = 0;
-    machine.prev_out_port_3 = 0;
-    machine.prev_out_port_5 = 0;
-
-    cpu_state.pc = 0;
-    cpu_state.memory = memory;
-
     // create SDL window
     SDL_Window *window = NULL;
 
-    // grab the window surface
-    SDL_Surface *screen;
-
     // initialize the video subsystem
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
     {
@@ -185,199 +316,202 @@ int main(int argc, char **argv)
     }
 
     // initialize the sounds.
-    init_sounds();
+    init_sounds(machine, game, synth);
 
     // create a window
     //printDelay("creating SDL window\n");
     int scale = screenSize;
-    window = SDL_CreateWindow("SDL2 Window", 20, 20, 224 * scale, 256 * scale, SDL_WINDOW_SHOWN);
-
-    screen = SDL_GetWindowSurface(window);
+    window = SDL_CreateWindow("SDL2 Window", 20, 20, 224 * scale, 256 * scale, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
 
-    // pointer to the framebuffer
-    uint8_t *framebuffer;
+    // the screen is scaled by the renderer, scale only sets the starting size
+    if (init_display(window, game) < 0)
+    {
+        close_sounds(machine);
+        machine_destroy(machine);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
 
     // state of the program
-    int running = 1;
+    running = 1;
 
-    // store when the last timer occurred for redrawing the screen
-    double lastTimer = 0;
+    // start recording. the writer reports a closed fifo instead of the
+    // process dying of SIGPIPE.
+    if (y4m != NULL)
+    {
+        signal(SIGPIPE, SIG_IGN);
+        video = shots_start(y4m, SHOT_Y4M, game, 1);
+    }
+
+    // start the emulation
+    frames_init(&frames);
+    frame_event = SDL_RegisterEvents(1);
+    machine->keys = &held_keys;
+    if (measure_latency && latency_init(&latency, machine) < 0)
+    {
+        measure_latency = 0;
+    }
+    SDL_Thread *emulation = SDL_CreateThread(emulate, "emulation", machine);
+    if (emulation == NULL)
+    {
+        printf("unable to start the emulation thread: %s\n", SDL_GetError());
+        running = 0;
+    }
 
     //printDelay("starting game loop\n");
     while (running) // infinite game loop?
     {
-        double now = time_ms();
-        double elapsed = now - lastTimer;
         //  game loop
-        //  1. read input from keyboard.
+        //  1. sleep until there is input or a new frame, then read all the
+        //  events. the timeout only matters if a frame event went missing.
         SDL_Event event;
-        while (SDL_PollEvent(&event))
+        for (int more = SDL_WaitEventTimeout(&event, 100); more; more = SDL_PollEvent(&event))
         {
             if (event.type == SDL_QUIT)
             {
                 running = 0;
             }
 
+            // the window was uncovered or resized, show the screen again
+            else if (event.type == SDL_WINDOWEVENT &&
+                     (event.window.event == SDL_WINDOWEVENT_EXPOSED || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED))
+            {
+                present_screen();
+            }
+
             else if (event.type == SDL_KEYDOWN) // change to switch
             {
                 if (event.key.keysym.sym == SDLK_RIGHT)
                 {
-                    key_down(&machine, KEY_P1_RIGHT);
+                    hold_key(KEY_P1_RIGHT);
                 }
                 if (event.key.keysym.sym == SDLK_LEFT)
                 {
-                    key_down(&machine, KEY_P1_LEFT);
+                    hold_key(KEY_P1_LEFT);
                 }
                 if (event.key.keysym.sym == SDLK_c)
                 {
-                    key_down(&machine, KEY_COIN);
+                    hold_key(KEY_COIN);
                 }
                 if (event.key.keysym.sym == SDLK_z)
                 {
-                    key_down(&machine, KEY_P1_START);
+                    hold_key(KEY_P1_START);
                 }
                 if (event.key.keysym.sym == SDLK_x)
                 {
-                    key_down(&machine, KEY_P1_SHOOT);
+                    hold_key(KEY_P1_SHOOT);
                 }
 
                 // player 2
                 if (event.key.keysym.sym == SDLK_a)
                 {
-                    key_down(&machine, KEY_P2_START);
+                    hold_key(KEY_P2_START);
                 }
                 if (event.key.keysym.sym == SDLK_s)
                 {
-                    key_down(&machine, KEY_P2_SHOOT);
+                    hold_key(KEY_P2_SHOOT);
                 }
                 if (event.key.keysym.sym == SDLK_RIGHT)
                 {
-                    key_down(&machine, KEY_P2_RIGHT);
+                    hold_key(KEY_P2_RIGHT);
                 }
                 if (event.key.keysym.sym == SDLK_LEFT)
                 {
-                    key_down(&machine, KEY_P2_LEFT);
+                    hold_key(KEY_P2_LEFT);
                 }
 
                 // tilt - not sure if this does anything?
                 if (event.key.keysym.sym == SDLK_d)
                 {
-                    key_down(&machine, KEY_TILT);
+                    hold_key(KEY_TILT);
                 }
             }
             if (event.type == SDL_KEYUP) // change to switch
             {
                 if (event.key.keysym.sym == SDLK_RIGHT)
                 {
-                    key_up(&machine, KEY_P1_RIGHT);
+                    release_key(KEY_P1_RIGHT);
                 }
                 if (event.key.keysym.sym == SDLK_LEFT)
                 {
-                    key_up(&machine, KEY_P1_LEFT);
+                    release_key(KEY_P1_LEFT);
                 }
                 if (event.key.keysym.sym == SDLK_c)
                 {
-                    key_up(&machine, KEY_COIN);
+                    release_key(KEY_COIN);
                 }
                 if (event.key.keysym.sym == SDLK_z)
                 {
-                    key_up(&machine, KEY_P1_START);
+                    release_key(KEY_P1_START);
                 }
                 if (event.key.keysym.sym == SDLK_x)
                 {
-                    key_up(&machine, KEY_P1_SHOOT);
+                    release_key(KEY_P1_SHOOT);
                 }
 
                 // player 2
                 if (event.key.keysym.sym == SDLK_a)
                 {
-                    key_up(&machine, KEY_P2_START);
+                    release_key(KEY_P2_START);
                 }
                 if (event.key.keysym.sym == SDLK_s)
                 {
-                    key_up(&machine, KEY_P2_SHOOT);
+                    release_key(KEY_P2_SHOOT);
                 }
                 if (event.key.keysym.sym == SDLK_RIGHT)
                 {
-                    key_up(&machine, KEY_P2_RIGHT);
+                    release_key(KEY_P2_RIGHT);
                 }
                 if (event.key.keysym.sym == SDLK_LEFT)
                 {
-                    key_up(&machine, KEY_P2_LEFT);
+                    release_key(KEY_P2_LEFT);
                 }
 
                 // tilt - not sure if this does anything?
                 if (event.key.keysym.sym == SDLK_d)
                 {
-                    key_up(&machine, KEY_TILT);
+                    release_key(KEY_TILT);
                 }
             }
         }
 
-        // 2. update state - perform emulation
-        run_cpu(&machine);
-
-        // 3. get the current frame buffer - pointer to the starting address
-        framebuffer = get_framebuffer(&cpu_state);
-
-        // 4. draw the screen - should run on a timer for 16ms
-        if (elapsed > 16)
+        // 2. draw the newest frame the emulation finished, if there is one.
+        // see https://www.reddit.com/r/EmuDev/comments/uxiux8/having_trouble_writing_the_space_invaders_video/
+        // mem location 2400 has pixels (0,255),(0,254),(0,253),(0,252),(0,251),(0,250),(0,249),(0,248)
+        Frame *frame = frames_take(&frames);
+        if (frame != NULL)
         {
-            // clear the screen
-            wipe_surface(screen);
-
-            // see https://www.reddit.com/r/EmuDev/comments/uxiux8/having_trouble_writing_the_space_invaders_video/
-            // mem location 2400 has pixels (0,255),(0,254),(0,253),(0,252),(0,251),(0,250),(0,249),(0,248)
-            int dx = 0;
-            int dy = 0;
-            for (int i = 0; i < 256 * 28; i++)
+            // only the columns that changed since the last frame drawn are
+            // uploaded, and the frame is only presented if there were any
+            draw_screen(frame->vram, frame->columns);
+            if (measure_latency)
             {
-                // loop through each byte in the frame buffer
-                for (int j = 0; j < 8; j++)
-                {
-                    if (framebuffer[i] & (1 << j))
-                    {
-                        // set the pixel at dx,dy
-
-                        // this gives a scanline looking effect?
-                        // try to add some color as well based on the y value
-                        for (int k = 0; k < scale; k++)
-                        {
-                            // score display - top of screen - this number will change depending on scale
-                            if (((256 * scale - 1) - dy) < (256 * scale - 1) / 5)
-                            {
-                                set_pixel(screen, dx + k, (256 * scale - 1) - dy, 255, 0, 0);
-                            }
-
-                            // bottom of screen
-                            else if (((256 * scale - 1) - dy) > (9 * (256 * scale - 1) / 10))
-                            {
-                                set_pixel(screen, dx + k, (256 * scale - 1) - dy, 0, 0, 255);
-                            }
-
-                            // white pixel
-                            else
-                            {
-                                set_pixel(screen, dx + k, (256 * scale - 1) - dy, 255, 255, 255);
-                            }
-                        }
-                    }
-                    dy += scale;
-                    if (dy >= 256 * scale)
-                    {
-                        dx += scale;
-                        dy = 0;
-                    }
-                }
+                latency_present(&latency, frame->cycles);
             }
-
-            // update the display and set timer
-            SDL_UpdateWindowSurface(window);
-            lastTimer = now;
         }
     }
 
+    if (emulation != NULL)
+    {
+        SDL_WaitThread(emulation, NULL);
+    }
+    if (measure_latency)
+    {
+        latency_report(&latency);
+        latency_free(&latency);
+    }
+    if (video != NULL)
+    {
+        int lost = shots_finish(video);
+        printf("     recorded %d of %d frames to %s (%d dropped, %d not written)\n",
+               video_frames - video_dropped - lost, video_frames, y4m, video_dropped, lost);
+    }
+
     // close the window and quit
+    close_display();
+    close_sounds(machine);
+    machine_destroy(machine);
     SDL_DestroyWindow(window);
     SDL_Quit();
 
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "audio.h"
+#include "bank.h"
+
+// pack samples into a sound bank (bank.h) for the game to map at startup.
+// every wav file is converted to the mixer's format here, once, instead of
+// on every launch. the n-th file becomes sound number n-1, the one the
+// sound port bits play.
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc - 2 > MIX_SOUNDS)
+    {
+        printf("usage: %s BANK [WAV...]\n", argv[0]);
+        printf("  packs the wav files, by default the %d in sounds/, into BANK\n", NUM_SOUNDS);
+        return 1;
+    }
+    const char *path = argv[1];
+    int count = argc > 2 ? argc - 2 : NUM_SOUNDS;
+    const char **files = argc > 2 ? (const char **)argv + 2 : wav_files;
+
+    int16_t *samples[MIX_SOUNDS] = {NULL};
+    int length[MIX_SOUNDS] = {0};
+    long bytes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        // a file that can't be read leaves a gap, as it would at runtime
+        samples[i] = audio_load_wav(files[i], &length[i]);
+        if (samples[i] == NULL)
+        {
+            printf("unable to load wav file: %s\n", files[i]);
+            continue;
+        }
+        bytes += length[i] * sizeof(int16_t);
+    }
+
+    int result = bank_write(path, samples, length, count);
+    if (result < 0)
+    {
+        printf("unable to write %s\n", path);
+    }
+    else
+    {
+        printf("%d sounds, %ld bytes of samples at %d Hz written to %s\n", count, bytes, MIX_RATE, path);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        free(samples[i]);
+    }
+    return result < 0;
+}
@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+
+int image_write_ppm(const char *path, const uint32_t *pixels, int width, int height)
+{
+    FILE *file = fopen(path, "wb");
+    uint8_t *row = malloc(width * 3);
+    if (file == NULL || row == NULL)
+    {
+        fprintf(stderr, "unable to write %s\n", path);
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        free(row);
+        return -1;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint32_t pixel = pixels[y * width + x];
+            row[x * 3] = pixel >> 16;
+            row[x * 3 + 1] = pixel >> 8;
+            row[x * 3 + 2] = pixel;
+        }
+        fwrite(row, 3, width, file);
+    }
+    free(row);
+
+    if (ferror(file) | fclose(file))
+    {
+        fprintf(stderr, "unable to write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// deflate with the fixed huffman codes (RFC 1951). the screen is mostly
+// runs of one colour and rows like the one above, so the only matches
+// tried are the previous byte and the byte one row up. that gets close to
+// what zlib does on these images at a fraction of the code.
+
+static const uint16_t length_base[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                         31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                         2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,    65,    97,    129,
+                                       193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                       6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+#define MAX_MATCH 258
+#define MAX_DISTANCE 32768
+
+typedef struct BitWriter
+{
+    uint8_t *out;
+    size_t size;
+    uint64_t bits;
+    int count;
+} BitWriter;
+
+// deflate packs values from the lowest bit up
+static void put_bits(BitWriter *writer, uint32_t value, int count)
+{
+    writer->bits |= (uint64_t)value << writer->count;
+    writer->count += count;
+    while (writer->count >= 8)
+    {
+        writer->out[writer->size++] = writer->bits;
+        writer->bits >>= 8;
+        writer->count -= 8;
+    }
+}
+
+// huffman codes go in from their top bit down
+static void put_code(BitWriter *writer, uint32_t code, int count)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    put_bits(writer, reversed, count);
+}
+
+static void put_symbol(BitWriter *writer, int symbol)
+{
+    if (symbol < 144)
+    {
+        put_code(writer, 0x30 + symbol, 8);
+    }
+    else if (symbol < 256)
+    {
+        put_code(writer, 0x190 + symbol - 144, 9);
+    }
+    else if (symbol < 280)
+    {
+        put_code(writer, symbol - 256, 7);
+    }
+    else
+    {
+        put_code(writer, 0xc0 + symbol - 280, 8);
+    }
+}
+
+static void put_match(BitWriter *writer, int length, int distance)
+{
+    int i = 28;
+    while (length_base[i] > length)
+    {
+        i--;
+    }
+    put_symbol(writer, 257 + i);
+    put_bits(writer, length - length_base[i], length_extra[i]);
+
+    int j = 29;
+    while (dist_base[j] > distance)
+    {
+        j--;
+    }
+    put_code(writer, j, 5);
+    put_bits(writer, distance - dist_base[j], dist_extra[j]);
+}
+
+static int match_length(const uint8_t *data, size_t i, size_t size, int distance)
+{
+    int length = 0;
+    while (i + length < size && length < MAX_MATCH && data[i + length] == data[i + length - distance])
+    {
+        length++;
+    }
+    return length;
+}
+
+static uint32_t adler32(const uint8_t *data, size_t size)
+{
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+// zlib stream of data into out, which needs room for 2 * size + 16 bytes.
+// stride is the distance to the same byte one row up. returns the size.
+static size_t zlib_compress(uint8_t *out, const uint8_t *data, size_t size, int stride)
+{
+    BitWriter writer = {out, 0, 0, 0};
+    put_bits(&writer, 0x0178, 16); // deflate, 32K window, no dictionary, fastest
+    put_bits(&writer, 1, 1);       // last block
+    put_bits(&writer, 1, 2);       // fixed codes
+
+    size_t i = 0;
+    while (i < size)
+    {
+        int length = 0, distance = 0;
+        if (i >= 1)
+        {
+            length = match_length(data, i, size, 1);
+            distance = 1;
+        }
+        if (i >= (size_t)stride)
+        {
+            int above = match_length(data, i, size, stride);
+            if (above > length)
+            {
+                length = above;
+                distance = stride;
+            }
+        }
+
+        if (length >= 3)
+        {
+            put_match(&writer, length, distance);
+            i += length;
+        }
+        else
+        {
+            put_symbol(&writer, data[i]);
+            i++;
+        }
+    }
+    put_symbol(&writer, 256);
+    if (writer.count > 0)
+    {
+        put_bits(&writer, 0, 8 - writer.count); // pad out the last byte
+    }
+
+    uint32_t check = adler32(data, size);
+    for (int k = 24; k >= 0; k -= 8)
+    {
+        out[writer.size++] = check >> k;
+    }
+    return writer.size;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void put_be32(uint8_t *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static void write_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t size)
+{
+    uint8_t word[4];
+    put_be32(word, size);
+    fwrite(word, 1, 4, file);
+    fwrite(type, 1, 4, file);
+    fwrite(data, 1, size, file);
+    put_be32(word, crc32(crc32(0, (const uint8_t *)type, 4), data, size));
+    fwrite(word, 1, 4, file);
+}
+
+int image_write_png(const char *path, const uint32_t *pixels, int width, int height)
+{
+    // one filter byte (0, none) in front of every row of palette indices
+    int stride = width + 1;
+    if (stride > MAX_DISTANCE)
+    {
+        fprintf(stderr, "unable to write %s: %d pixels is too wide\n", path, width);
+        return -1;
+    }
+    size_t size = (size_t)stride * height;
+    uint8_t *raw = malloc(size);
+    uint8_t *packed = malloc(2 * size + 16);
+    if (raw == NULL || packed == NULL)
+    {
+        fprintf(stderr, "unable to write %s\n", path);
+        free(raw);
+        free(packed);
+        return -1;
+    }
+
+    uint8_t palette[256 * 3];
+    uint32_t colors[256];
+    int num_colors = 0, last = 0;
+    for (int y = 0; y < height; y++)
+    {
+        raw[y * stride] = 0;
+        for (int x = 0; x < width; x++)
+        {
+            uint32_t color = pixels[y * width + x] & 0xffffff;
+            if (num_colors == 0 || colors[last] != color)
+            {
+                last = 0;
+                while (last < num_colors && colors[last] != color)
+                {
+                    last++;
+                }
+                if (last == num_colors)
+                {
+                    if (num_colors == 256)
+                    {
+                        fprintf(stderr, "unable to write %s: more than 256 colours\n", path);
+                        free(raw);
+                        free(packed);
+                        return -1;
+                    }
+                    colors[num_colors] = color;
+                    palette[num_colors * 3] = color >> 16;
+                    palette[num_colors * 3 + 1] = color >> 8;
+                    palette[num_colors * 3 + 2] = color;
+                    num_colors++;
+                }
+            }
+            raw[y * stride + 1 + x] = last;
+        }
+    }
+    size_t packed_size = zlib_compress(packed, raw, size, stride);
+    free(raw);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "unable to write %s\n", path);
+        free(packed);
+        return -1;
+    }
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(signature, 1, sizeof(signature), file);
+
+    uint8_t header[13];
+    put_be32(header, width);
+    put_be32(header + 4, height);
+    header[8] = 8;   // bits per index
+    header[9] = 3;   // palette colour
+    header[10] = 0;  // deflate
+    header[11] = 0;  // adaptive filtering
+    header[12] = 0;  // not interlaced
+    write_chunk(file, "IHDR", header, sizeof(header));
+    write_chunk(file, "PLTE", palette, num_colors * 3);
+    write_chunk(file, "IDAT", packed, packed_size);
+    write_chunk(file, "IEND", NULL, 0);
+    free(packed);
+
+    if (ferror(file) | fclose(file))
+    {
+        fprintf(stderr, "unable to write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
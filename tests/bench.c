@@ -0,0 +1,1567 @@
+// throughput benchmarks for the headless parts of the emulator
+
+// to compile (from project root)
+// make bench
+
+// to run (from project root):
+// ./i8080-bench
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio.h"
+#include "bank.h"
+#include "batch.h"
+#include "controls.h"
+#include "env.h"
+#include "frames.h"
+#include "games.h"
+#include "interrupts.h"
+#include "latency.h"
+#include "machine.h"
+#include "memory.h"
+#include "mixer.h"
+#include "overlay.h"
+#include "ports.h"
+#include "shots.h"
+#include "video.h"
+
+// checks that failed, for main's exit status
+static int failed_checks;
+
+// the word a check prints: pass, or fail counted as a failed check
+static const char *check(int ok, const char *pass, const char *fail)
+{
+    failed_checks += !ok;
+    return ok ? pass : fail;
+}
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// run env_step with a fixed action pattern and report steps per second
+static void bench_env(int obs_type, int frames, int steps)
+{
+    Env *env = env_create(obs_type);
+    if (env == NULL || env_reset(env, GAME_INVADERS) < 0)
+    {
+        printf("env: could not start Space Invaders (run from the project root)\n");
+        exit(1);
+    }
+
+    EnvStep result;
+    long total_reward = 0;
+    int episodes = 1;
+    double start = now_s();
+    for (int i = 0; i < steps; i++)
+    {
+        int action = (i & 1 ? ENV_FIRE : 0) | ((i / 64) & 1 ? ENV_LEFT : ENV_RIGHT);
+        env_step(env, action, frames, &result);
+        total_reward += result.reward;
+        if (result.done)
+        {
+            env_reset(env, GAME_INVADERS);
+            episodes++;
+        }
+    }
+    double elapsed = now_s() - start;
+
+    printf("env_step %-4s frames=%d: %8.0f steps/s (%ld points, %d episodes)\n",
+           obs_type == ENV_OBS_GRAY ? "gray" : "vram", frames, steps / elapsed, total_reward, episodes);
+    env_destroy(env);
+}
+
+// inputs for one lane: coin up and start together, then (if perturb is set)
+// every lane fires on its own schedule so the lanes drift apart
+static void lane_input(SpaceInvadersMachine *machine, int lane, int frame, int perturb)
+{
+    if (frame == 20)
+        key_down(machine, KEY_COIN);
+    if (frame == 25)
+        key_up(machine, KEY_COIN);
+    if (frame == 40)
+        key_down(machine, KEY_P1_START);
+    if (frame == 100)
+        key_up(machine, KEY_P1_START);
+    if (perturb && frame > 100)
+    {
+        if ((frame + 7 * lane) % 40 == 0)
+            key_down(machine, KEY_P1_SHOOT);
+        if ((frame + 7 * lane) % 40 == 4)
+            key_up(machine, KEY_P1_SHOOT);
+    }
+}
+
+static void load_lanes(SpaceInvadersMachine **machines, int lanes)
+{
+    for (int i = 0; i < lanes; i++)
+    {
+        machines[i] = machine_create();
+        if (machines[i] == NULL || mem_init(machines[i]) < 0)
+        {
+            printf("batch: could not load Space Invaders (run from the project root)\n");
+            exit(1);
+        }
+    }
+}
+
+// when a lane read its inputs, folded into one number
+static void time_reads(SpaceInvadersMachine *machine, uint8_t port, void *data)
+{
+    uint64_t *reads = data;
+    *reads = hash_mix(*reads ^ machine_cycles(machine) ^ (uint64_t)port << 56);
+}
+
+// compare the lockstep engine against the same number of scalar machines
+// on one thread, and check that both end up in the same state, having read
+// their inputs at the same emulated times
+static void bench_batch(int lanes, int frames, int perturb)
+{
+    SpaceInvadersMachine *scalar[BATCH_LANES];
+    SpaceInvadersMachine *lockstep[BATCH_LANES];
+    uint64_t scalar_reads[BATCH_LANES] = {0};
+    uint64_t lockstep_reads[BATCH_LANES] = {0};
+    load_lanes(scalar, lanes);
+    load_lanes(lockstep, lanes);
+    for (int i = 0; i < lanes; i++)
+    {
+        scalar[i]->input_hook = lockstep[i]->input_hook = time_reads;
+        scalar[i]->input_hook_data = &scalar_reads[i];
+        lockstep[i]->input_hook_data = &lockstep_reads[i];
+    }
+
+    double start = now_s();
+    for (int f = 0; f < frames; f++)
+    {
+        for (int i = 0; i < lanes; i++)
+        {
+            lane_input(scalar[i], i, f, perturb);
+            run_frame(scalar[i]);
+        }
+    }
+    double scalar_time = now_s() - start;
+
+    Batch *batch = batch_create(lockstep, lanes);
+    start = now_s();
+    for (int f = 0; f < frames; f++)
+    {
+        for (int i = 0; i < lanes; i++)
+        {
+            lane_input(lockstep[i], i, f, perturb);
+        }
+        batch_run_frame(batch);
+    }
+    double batch_time = now_s() - start;
+
+    int same = 1;
+    for (int i = 0; i < lanes; i++)
+    {
+        State8080 *x = &scalar[i]->state;
+        State8080 *y = &lockstep[i]->state;
+        if (memcmp(scalar[i]->memory, lockstep[i]->memory, MEM_SIZE) != 0 ||
+            x->pc != y->pc || x->sp != y->sp || x->a != y->a || x->h != y->h || x->l != y->l ||
+            scalar_reads[i] != lockstep_reads[i])
+        {
+            same = 0;
+        }
+    }
+
+    uint64_t total = batch->vector_lanes + batch->scalar_steps;
+    printf("batch %2d lanes %s: scalar %7.1f frames/s, lockstep %7.1f frames/s (%.2fx), %4.1f%% vectorized, %s\n",
+           lanes, perturb ? "perturbed" : "attract  ", lanes * frames / scalar_time, lanes * frames / batch_time,
+           scalar_time / batch_time, 100.0 * batch->vector_lanes / total, check(same, "states match", "STATES DIFFER"));
+
+    batch_destroy(batch);
+    for (int i = 0; i < lanes; i++)
+    {
+        machine_destroy(scalar[i]);
+        machine_destroy(lockstep[i]);
+    }
+}
+
+// tree search pattern: snapshot a game in progress, then play different
+// inputs from it by restoring it into a worker machine. checks that a
+// restored machine runs exactly like the original.
+static void bench_snapshot(int count)
+{
+    SpaceInvadersMachine *root;
+    SpaceInvadersMachine *worker;
+    load_lanes(&root, 1);
+    load_lanes(&worker, 1);
+    for (int f = 0; f < 200; f++)
+    {
+        lane_input(root, 0, f, 0);
+        run_frame(root);
+    }
+    MachineSnapshot *node = machine_snapshot(root);
+    machine_restore(worker, node);
+
+    // rollouts restore the same node over and over, expanding also takes
+    // a snapshot of each child
+    double restore_time = 0, expand_restore_time = 0, snapshot_time = 0, copy_time = 0;
+    for (int i = 0; i < 2 * count; i++)
+    {
+        double start = now_s();
+        machine_restore(worker, node);
+        double restored = now_s();
+        key_down(worker, i & 1 ? KEY_P1_LEFT : KEY_P1_SHOOT);
+        run_frame(worker);
+        double ran = now_s();
+        if (i < count)
+        {
+            // what copying ROM + RAM for every branch would cost instead,
+            // at the same point
+            static uint8_t copy[RAM_END];
+            memcpy(copy, worker->memory, RAM_END);
+            __asm__ volatile("" : : "r"(copy) : "memory");
+            copy_time += now_s() - ran;
+            restore_time += restored - start;
+            continue;
+        }
+        snapshot_destroy(machine_snapshot(worker));
+        snapshot_time += now_s() - ran;
+        expand_restore_time += restored - start;
+    }
+
+    // take out the cost of reading the clock around every call
+    double clock_time = 0;
+    for (int i = 0; i < count; i++)
+    {
+        double start = now_s();
+        clock_time += now_s() - start;
+    }
+    restore_time -= clock_time;
+    expand_restore_time -= clock_time;
+    snapshot_time -= clock_time;
+    copy_time -= clock_time;
+
+    // a restored machine must follow the same path as the one it came from
+    machine_restore(root, node);
+    machine_restore(worker, node);
+    for (int f = 0; f < 300; f++)
+    {
+        lane_input(root, 0, f, 1);
+        lane_input(worker, 0, f, 1);
+        run_frame(root);
+        run_frame(worker);
+    }
+    int same = memcmp(root->memory, worker->memory, MEM_SIZE) == 0 && root->state.pc == worker->state.pc;
+
+    printf("snapshot: restore %.0f ns (%.0f ns after a child snapshot), snapshot + free %.0f ns, 16K copy %.0f ns, %s\n",
+           restore_time / count * 1e9, expand_restore_time / count * 1e9, snapshot_time / count * 1e9,
+           copy_time / count * 1e9, check(same, "restored runs match", "RESTORED RUNS DIFFER"));
+    snapshot_destroy(node);
+    machine_destroy(worker);
+    machine_destroy(root);
+}
+
+// per frame state hashes: reading the incremental machine_hash() against
+// hashing RAM from scratch, and a check that the incremental hash is right
+static void bench_hash(int count)
+{
+    SpaceInvadersMachine *machine;
+    load_lanes(&machine, 1);
+    for (int f = 0; f < 1000; f++)
+    {
+        lane_input(machine, 0, f, 1);
+        run_frame(machine);
+    }
+    int same = machine->state.mem_hash == mem_hash(machine);
+
+    uint64_t sum = 0;
+    double start = now_s();
+    for (int i = 0; i < count; i++)
+    {
+        machine->frameCycles = i; // keep the call in the loop
+        sum += machine_hash(machine);
+    }
+    double hash_time = (now_s() - start) / count;
+
+    start = now_s();
+    for (int i = 0; i < count / 100; i++)
+    {
+        machine->memory[RAM_START] = i;
+        uint64_t hash = 0;
+        for (int a = RAM_START; a < RAM_END; a++)
+        {
+            hash ^= mem_key(a, machine->memory[a]);
+        }
+        sum += hash;
+    }
+    double rehash_time = (now_s() - start) / (count / 100);
+
+    printf("hash: machine_hash %.0f ns, hashing RAM from scratch %.0f ns, %s\n", hash_time * 1e9,
+           rehash_time * 1e9, check(same, "incremental hash matches", "INCREMENTAL HASH DIFFERS"));
+    __asm__ volatile("" : : "r"(sum));
+    machine_destroy(machine);
+}
+
+// render a mid-game screen with the runtime-picked kernel and the scalar
+// reference, and check they agree pixel for pixel
+static void bench_video(int count, int scale)
+{
+    SpaceInvadersMachine *machine;
+    load_lanes(&machine, 1);
+    for (int f = 0; f < 300; f++)
+    {
+        lane_input(machine, 0, f, 1);
+        run_frame(machine);
+    }
+    const uint8_t *vram = &machine->memory[0x2400];
+
+    uint32_t row_color[SCREEN_HEIGHT];
+    for (int r = 0; r < SCREEN_HEIGHT; r++)
+    {
+        row_color[r] = 0xff000000 | (r * 0x010101);
+    }
+    int pitch = SCREEN_WIDTH * scale * sizeof(uint32_t);
+    size_t size = pitch * SCREEN_HEIGHT * scale;
+    uint32_t *fast = aligned_alloc(64, size);
+    uint32_t *slow = aligned_alloc(64, size);
+    memset(fast, 0x55, size);
+    memset(slow, 0xaa, size);
+
+    double start = now_s();
+    for (int i = 0; i < count; i++)
+    {
+        video_render(fast, pitch, vram, row_color, scale);
+    }
+    double fast_time = (now_s() - start) / count;
+
+    start = now_s();
+    for (int i = 0; i < count / 10; i++)
+    {
+        video_render_scalar(slow, pitch, vram, row_color, scale);
+    }
+    double slow_time = (now_s() - start) / (count / 10);
+
+    printf("video x%d: %s %.1f us, scalar %.1f us, %s\n", scale, video_kernel(), fast_time * 1e6,
+           slow_time * 1e6, check(memcmp(fast, slow, size) == 0, "kernels match", "KERNELS DIFFER"));
+    free(fast);
+    free(slow);
+    machine_destroy(machine);
+}
+
+// play for a while drawing only the dirty columns each frame, and check the
+// picture always equals a full redraw
+static void bench_dirty(int frames, int scale)
+{
+    SpaceInvadersMachine *machine;
+    load_lanes(&machine, 1);
+    const uint8_t *vram = &machine->memory[VRAM_START];
+    uint8_t *columns = &machine->dirty_lines[VRAM_START >> LINE_SHIFT];
+
+    uint32_t row_color[SCREEN_HEIGHT];
+    for (int r = 0; r < SCREEN_HEIGHT; r++)
+    {
+        row_color[r] = 0xff000000 | (r * 0x010101);
+    }
+    int pitch = SCREEN_WIDTH * scale * sizeof(uint32_t);
+    size_t size = pitch * SCREEN_HEIGHT * scale;
+    uint32_t *screen = aligned_alloc(64, size);
+    uint32_t *full = aligned_alloc(64, size);
+
+    long dirty = 0, runs = 0;
+    int same = 1;
+    double draw_time = 0, full_time = 0;
+    for (int f = 0; f < frames; f++)
+    {
+        lane_input(machine, 0, f, 1);
+        run_frame(machine);
+
+        double start = now_s();
+        int x = 0;
+        int width;
+        while ((width = video_next_run(columns, &x)) > 0)
+        {
+            video_render_columns(screen, pitch, vram, row_color, scale, x, width);
+            dirty += width;
+            runs++;
+            x += width;
+        }
+        double drawn = now_s();
+        video_render(full, pitch, vram, row_color, scale);
+        full_time += now_s() - drawn;
+        draw_time += drawn - start;
+        same &= memcmp(screen, full, size) == 0;
+    }
+
+    printf("dirty x%d: %.1f columns in %.1f runs per frame, %.1f us vs %.1f us full, %s\n", scale,
+           (double)dirty / frames, (double)runs / frames, draw_time / frames * 1e6, full_time / frames * 1e6,
+           check(same, "screens match", "SCREENS DIFFER"));
+    free(screen);
+    free(full);
+    machine_destroy(machine);
+}
+
+// give run_cpu a backlog of frames to catch up on and check that stopping
+// at every interrupt it returns leaves the machine exactly where run_frame
+// does
+static void bench_run_cpu(int frames)
+{
+    SpaceInvadersMachine *expected;
+    SpaceInvadersMachine *machine;
+    load_lanes(&expected, 1);
+    load_lanes(&machine, 1);
+
+    machine->lastTimer = time_us() - frames * 1e6 / 60;
+    int same = 1, rst1 = 0, rst2 = 0;
+    while (rst2 < frames)
+    {
+        int interrupt = run_cpu(machine);
+        if (interrupt == 1)
+        {
+            rst1++;
+        }
+        if (interrupt == 2)
+        {
+            rst2++;
+            run_frame(expected);
+            same &= machine_hash(machine) == machine_hash(expected);
+        }
+    }
+
+    printf("run_cpu: %d RST 1 and %d RST 2 in %d frames, %s\n", rst1, rst2, frames,
+           check(same, "matches run_frame", "DIFFERS FROM run_frame"));
+    machine_destroy(expected);
+    machine_destroy(machine);
+}
+
+// run_to_interrupt twice must be one run_frame, and wait_frame must keep
+// time while the thread spends most of it asleep
+static void bench_pacing(int frames)
+{
+    SpaceInvadersMachine *expected;
+    SpaceInvadersMachine *machine;
+    load_lanes(&expected, 1);
+    load_lanes(&machine, 1);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    double start = now_s();
+    clock_t cpu = clock();
+    int same = 1;
+    for (int i = 0; i < frames; i++)
+    {
+        same &= run_to_interrupt(machine) == 1;
+        same &= run_to_interrupt(machine) == 2;
+        run_frame(expected);
+        same &= machine_hash(machine) == machine_hash(expected);
+        wait_frame(&deadline, FRAME_NS);
+    }
+    double elapsed = now_s() - start;
+    double busy = (double)(clock() - cpu) / CLOCKS_PER_SEC;
+
+    // the absolute deadlines keep the total within a frame of real time.
+    // that depends on how busy the host is, so it isn't a failed check.
+    double drift = elapsed - frames * FRAME_NS / 1e9;
+    int on_time = drift < FRAME_NS / 1e9 && drift > -FRAME_NS / 1e9;
+    printf("pacing: %d frames in %.3f s, %.1f%% cpu, %s, %s\n", frames, elapsed, busy / elapsed * 100,
+           on_time ? "on time" : "DRIFTED", check(same, "matches run_frame", "DIFFERS FROM run_frame"));
+    machine_destroy(expected);
+    machine_destroy(machine);
+}
+
+// queue every nth frame to the screenshot writer and check the files
+// against video_render. reports how long the emulation waits per queued
+// frame, which is only more than a copy once the writer is SHOT_QUEUE behind.
+static void bench_shots(int frames, int every, int format)
+{
+    SpaceInvadersMachine *machine;
+    load_lanes(&machine, 1);
+    const uint8_t *vram = &machine->memory[VRAM_START];
+
+    char dir[] = "/tmp/bench-shotsXXXXXX";
+    if (mkdtemp(dir) == NULL)
+    {
+        printf("shots: could not make a directory in /tmp\n");
+        exit(1);
+    }
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "%s/", dir);
+    ShotWriter *writer = shots_start(prefix, format, GAME_INVADERS, 1);
+    uint8_t *saved = malloc((size_t)frames * VRAM_SIZE);
+
+    double queue_time = 0;
+    for (int f = 0; f < frames; f++)
+    {
+        lane_input(machine, 0, f, 1);
+        run_frame(machine);
+        if ((f + 1) % every == 0)
+        {
+            memcpy(saved + (size_t)f * VRAM_SIZE, vram, VRAM_SIZE);
+            double start = now_s();
+            shots_queue(writer, f + 1, vram);
+            queue_time += now_s() - start;
+        }
+    }
+    int shots = frames / every;
+    double start = now_s();
+    int failed = shots_finish(writer);
+    double drain = now_s() - start;
+
+    // ppm files are checked byte for byte, png files only for being there
+    uint32_t row_color[SCREEN_HEIGHT];
+    uint32_t pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
+    overlay_rows(row_color, GAME_INVADERS);
+    int same = failed == 0;
+    long bytes = 0;
+    for (int f = every - 1; f < frames; f += every)
+    {
+        char path[96];
+        snprintf(path, sizeof(path), "%s%06d.%s", prefix, f + 1, format == SHOT_PNG ? "png" : "ppm");
+        FILE *file = fopen(path, "rb");
+        if (file == NULL)
+        {
+            same = 0;
+            continue;
+        }
+        static uint8_t data[64 + SCREEN_WIDTH * SCREEN_HEIGHT * 3];
+        size_t size = fread(data, 1, sizeof(data), file);
+        fclose(file);
+        remove(path);
+        bytes += size;
+
+        if (format == SHOT_PPM)
+        {
+            video_render(pixels, SCREEN_WIDTH * sizeof(uint32_t), saved + (size_t)f * VRAM_SIZE, row_color, 1);
+            int header = snprintf(NULL, 0, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+            same &= size == header + sizeof(pixels) / 4 * 3;
+            for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT && same; i++)
+            {
+                const uint8_t *rgb = data + header + i * 3;
+                same &= (uint32_t)(rgb[0] << 16 | rgb[1] << 8 | rgb[2]) == (pixels[i] & 0xffffff);
+            }
+        }
+    }
+    remove(dir);
+
+    printf("shots %s every %d: %.1f us queueing per shot, %.0f ms left to write at the end, %ld bytes per file, %s\n",
+           format == SHOT_PNG ? "png" : "ppm", every, queue_time / shots * 1e6, drain * 1e3, bytes / shots,
+           check(same, "files match", "FILES DIFFER"));
+    free(saved);
+    machine_destroy(machine);
+}
+
+// stream frames as YUV4MPEG2 and check every one against video_render
+static void bench_y4m(int frames)
+{
+    SpaceInvadersMachine *machine;
+    load_lanes(&machine, 1);
+    const uint8_t *vram = &machine->memory[VRAM_START];
+
+    char path[] = "/tmp/bench-y4mXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        printf("y4m: could not make a file in /tmp\n");
+        exit(1);
+    }
+    close(fd);
+    uint8_t *saved = malloc((size_t)frames * VRAM_SIZE);
+
+    double start = now_s();
+    ShotWriter *writer = shots_start(path, SHOT_Y4M, GAME_INVADERS, 1);
+    for (int f = 0; f < frames; f++)
+    {
+        lane_input(machine, 0, f, 1);
+        run_frame(machine);
+        memcpy(saved + (size_t)f * VRAM_SIZE, vram, VRAM_SIZE);
+        shots_queue(writer, f + 1, vram);
+    }
+    int failed = shots_finish(writer);
+    double elapsed = now_s() - start;
+
+    int size = SCREEN_WIDTH * SCREEN_HEIGHT;
+    size_t frame_size = 6 + 3 * (size_t)size;
+    uint8_t *data = malloc(frame_size);
+    FILE *file = fopen(path, "rb");
+    char header[128];
+    int same = failed == 0 && file != NULL && fgets(header, sizeof(header), file) != NULL &&
+               strncmp(header, "YUV4MPEG2 W224 H256 ", 20) == 0;
+
+    uint32_t row_color[SCREEN_HEIGHT];
+    uint32_t pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
+    overlay_rows(row_color, GAME_INVADERS);
+    for (int f = 0; f < frames && same; f++)
+    {
+        same &= fread(data, 1, frame_size, file) == frame_size && memcmp(data, "FRAME\n", 6) == 0;
+        video_render(pixels, SCREEN_WIDTH * sizeof(uint32_t), saved + (size_t)f * VRAM_SIZE, row_color, 1);
+        for (int i = 0; i < size && same; i++)
+        {
+            int r = (pixels[i] >> 16) & 0xff, g = (pixels[i] >> 8) & 0xff, b = pixels[i] & 0xff;
+            same &= data[6 + i] == ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+            same &= data[6 + size + i] == ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            same &= data[6 + 2 * size + i] == ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+        }
+    }
+    same &= file != NULL && fgetc(file) == EOF;
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    remove(path);
+
+    printf("y4m: %d frames in %.0f ms, %.0f frames/s, %s\n", frames, elapsed * 1e3, frames / elapsed,
+           check(same, "stream matches", "STREAM DIFFERS"));
+    free(data);
+    free(saved);
+    machine_destroy(machine);
+}
+
+// random plays and stops on two mixers, one mixed with SSE2 and one with
+// plain C, must give the same samples. stopping the looping sound must
+// leave the other voices playing, and sounds must start at the sample
+// their time asks for.
+static void bench_mixer(int buffers, int frames)
+{
+    Mixer *mixer = mixer_create();
+    Mixer *scalar = mixer_create();
+    unsigned int seed = 7;
+    for (int sound = 0; sound < NUM_SOUNDS; sound++)
+    {
+        int length = 1000 + rand_r(&seed) % 40000;
+        int16_t *samples = malloc(length * sizeof(int16_t));
+        for (int i = 0; i < length; i++)
+        {
+            samples[i] = rand_r(&seed) % 40000 - 20000;
+        }
+        mixer_load(mixer, sound, samples, length);
+        mixer_load(scalar, sound, samples, length);
+        free(samples);
+    }
+
+    int16_t *out = malloc(frames * sizeof(int16_t));
+    int16_t *expected = malloc(frames * sizeof(int16_t));
+    int same = 1;
+    double mix_time = 0;
+    uint64_t at = 0;
+    for (int b = 0; b < buffers; b++)
+    {
+        for (int c = rand_r(&seed) % 4; c > 0; c--)
+        {
+            int sound = rand_r(&seed) % NUM_SOUNDS;
+            int op = rand_r(&seed) % 4;
+            at += rand_r(&seed) % frames;
+            if (op == 0)
+            {
+                mixer_stop(mixer, sound, at);
+                mixer_stop(scalar, sound, at);
+            }
+            else
+            {
+                mixer_play(mixer, sound, op == 1, at);
+                mixer_play(scalar, sound, op == 1, at);
+            }
+        }
+        double start = now_s();
+        mixer_render(mixer, out, frames);
+        mix_time += now_s() - start;
+        mixer_render_scalar(scalar, expected, frames);
+        same &= memcmp(out, expected, frames * sizeof(int16_t)) == 0;
+    }
+    mixer_destroy(mixer);
+    mixer_destroy(scalar);
+
+    // a looping sound and a one-shot together, then the loop is stopped:
+    // the one-shot has to go on exactly as if it played alone. all at the
+    // same time, so everything starts MIX_LATENCY samples in.
+    int16_t one[64], loop[64];
+    for (int i = 0; i < 64; i++)
+    {
+        one[i] = i + 1;
+        loop[i] = 1000;
+    }
+    Mixer *both = mixer_create();
+    mixer_load(both, 0, loop, 8);
+    mixer_load(both, 1, one, 64);
+    mixer_play(both, 0, 1, 500);
+    mixer_play(both, 1, 0, 500);
+    mixer_stop(both, 0, 516);
+    int16_t stream[MIX_LATENCY + 32];
+    mixer_render(both, stream, MIX_LATENCY + 32);
+    for (int i = 0; i < MIX_LATENCY + 32; i++)
+    {
+        int k = i - MIX_LATENCY;
+        same &= stream[i] == (k < 0 ? 0 : k < 16 ? one[k] + 1000 : one[k]);
+    }
+    mixer_destroy(both);
+
+    // the same timed clicks mixed in buffers of different sizes land on
+    // the same samples
+    int16_t click[4] = {100, 200, 300, 400};
+    int16_t *split = malloc(4096 * sizeof(int16_t));
+    for (int size = 1; size <= 4096; size *= 7)
+    {
+        Mixer *timed = mixer_create();
+        mixer_load(timed, 0, click, 4);
+        for (int k = 0; k < 10; k++)
+        {
+            mixer_play(timed, 0, 0, 777 + k * 301);
+        }
+        for (int done = 0; done < 4096; done += size)
+        {
+            mixer_render(timed, split + done, done + size > 4096 ? 4096 - done : size);
+        }
+        for (int i = 0; i < 4096; i++)
+        {
+            int k = i - MIX_LATENCY;
+            same &= split[i] == (k >= 0 && k % 301 < 4 && k / 301 < 10 ? click[k % 301] : 0);
+        }
+        mixer_destroy(timed);
+    }
+    free(split);
+
+    printf("mixer: %d buffers of %d, %.2f us per buffer, %s\n", buffers, frames, mix_time / buffers * 1e6,
+           check(same, "mixes match", "MIXES DIFFER"));
+    free(out);
+    free(expected);
+}
+
+// random port writes on two mixers, one synthesizing with SSE2 and one with
+// plain C, must give the same samples. nothing may sound while the amp bit
+// is off, and a sound must start at the sample of its port write.
+static void bench_synth(int buffers, int frames)
+{
+    Mixer *mixer = mixer_create();
+    Mixer *scalar = mixer_create();
+    int16_t *out = malloc(frames * sizeof(int16_t));
+    int16_t *expected = malloc(frames * sizeof(int16_t));
+    unsigned int seed = 11;
+    int same = 1;
+    long loud = 0;
+    double synth_time = 0;
+    uint64_t at = 0;
+    for (int b = 0; b < buffers; b++)
+    {
+        for (int c = rand_r(&seed) % 3; c > 0; c--)
+        {
+            // mostly with the amp on, as in a game
+            int port = rand_r(&seed) % 2 ? 3 : 5;
+            uint8_t value = rand_r(&seed) % 256;
+            value = port == 3 && rand_r(&seed) % 8 ? value | 0x20 : value;
+            at += rand_r(&seed) % frames;
+            mixer_port(mixer, port, value, at);
+            mixer_port(scalar, port, value, at);
+        }
+        double start = now_s();
+        mixer_render(mixer, out, frames);
+        synth_time += now_s() - start;
+        mixer_render_scalar(scalar, expected, frames);
+        same &= memcmp(out, expected, frames * sizeof(int16_t)) == 0;
+        for (int i = 0; i < frames; i++)
+        {
+            loud += out[i] != 0;
+        }
+    }
+    same &= loud > 0;
+    mixer_destroy(mixer);
+    mixer_destroy(scalar);
+
+    // every sound on with the amp off, then the amp on
+    Mixer *timed = mixer_create();
+    mixer_port(timed, 5, 0x1f, 100);
+    mixer_port(timed, 3, 0x1f, 100);
+    mixer_port(timed, 3, 0x3f, 300);
+    int16_t stream[MIX_LATENCY + 1000];
+    mixer_render(timed, stream, MIX_LATENCY + 1000);
+    int first = -1;
+    for (int i = 0; i < MIX_LATENCY + 1000 && first < 0; i++)
+    {
+        first = stream[i] != 0 ? i - MIX_LATENCY : -1;
+    }
+    // the first command sets the output MIX_LATENCY behind, so time 100
+    // is sample MIX_LATENCY
+    same &= first == 300 - 100;
+    mixer_destroy(timed);
+
+    printf("synth: %d buffers of %d, %.2f us per buffer, %s\n", buffers, frames, synth_time / buffers * 1e6,
+           check(same, "synth matches", "SYNTH DIFFERS"));
+    free(out);
+    free(expected);
+}
+
+// pack the sounds into a bank, then load them count times from the wav
+// files and from the bank. the mapped bank must play exactly the same
+// samples as the decoded files.
+static void bench_bank(int count)
+{
+    int16_t *samples[NUM_SOUNDS];
+    int length[NUM_SOUNDS];
+    for (int i = 0; i < NUM_SOUNDS; i++)
+    {
+        samples[i] = audio_load_wav(wav_files[i], &length[i]);
+    }
+    char path[] = "/tmp/bench-bankXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || bank_write(path, samples, length, NUM_SOUNDS) < 0)
+    {
+        printf("bank: could not write a bank in /tmp\n");
+        exit(1);
+    }
+    close(fd);
+
+    double start = now_s();
+    for (int n = 0; n < count; n++)
+    {
+        Mixer *mixer = mixer_create();
+        for (int i = 0; i < NUM_SOUNDS; i++)
+        {
+            int16_t *wav = audio_load_wav(wav_files[i], &length[i]);
+            mixer_load(mixer, i, wav, length[i]);
+            free(wav);
+        }
+        mixer_destroy(mixer);
+    }
+    double wav_time = (now_s() - start) / count;
+    start = now_s();
+    int loaded = 0;
+    for (int n = 0; n < count; n++)
+    {
+        Mixer *mixer = mixer_create();
+        loaded = mixer_load_bank(mixer, path);
+        mixer_destroy(mixer);
+    }
+    double bank_time = (now_s() - start) / count;
+
+    // every sound, one after the other, from both
+    Mixer *decoded = mixer_create();
+    Mixer *mapped = mixer_create();
+    mixer_load_bank(mapped, path);
+    int total = 0;
+    for (int i = 0; i < NUM_SOUNDS; i++)
+    {
+        mixer_load(decoded, i, samples[i], length[i]);
+        mixer_play(decoded, i, 0, total);
+        mixer_play(mapped, i, 0, total);
+        total += length[i];
+    }
+    int16_t *a = malloc((total + MIX_LATENCY) * sizeof(int16_t));
+    int16_t *b = malloc((total + MIX_LATENCY) * sizeof(int16_t));
+    mixer_render(decoded, a, total + MIX_LATENCY);
+    mixer_render(mapped, b, total + MIX_LATENCY);
+    int same = loaded == NUM_SOUNDS && memcmp(a, b, (total + MIX_LATENCY) * sizeof(int16_t)) == 0;
+    mixer_destroy(decoded);
+    mixer_destroy(mapped);
+    remove(path);
+
+    printf("bank: %d sounds loaded in %.0f us from wav files, %.1f us from a bank, %s\n", NUM_SOUNDS,
+           wav_time * 1e6, bank_time * 1e6, check(same, "sounds match", "SOUNDS DIFFER"));
+    free(a);
+    free(b);
+    for (int i = 0; i < NUM_SOUNDS; i++)
+    {
+        free(samples[i]);
+    }
+}
+
+// the Space Invaders board as the port and key code had it wired in before
+// the games tables, kept here as the reference the tables must reproduce
+typedef struct WiredPorts
+{
+    uint8_t in1, in2, shift0, shift1, offset, out3, out5;
+} WiredPorts;
+
+static uint8_t wired_in(WiredPorts *w, uint8_t port)
+{
+    uint16_t v = (w->shift1 << 8) | w->shift0;
+    switch (port)
+    {
+    case 0:
+        return 1;
+    case 1:
+        return w->in1;
+    case 2:
+        return w->in2;
+    case 3:
+        return (v >> (8 - w->offset)) & 0xff;
+    }
+    return 0;
+}
+
+static void wired_out(WiredPorts *w, uint8_t port, uint8_t value)
+{
+    switch (port)
+    {
+    case 2:
+        w->offset = value & 0x7;
+        break;
+    case 3:
+        w->out3 = value;
+        break;
+    case 4:
+        w->shift0 = w->shift1;
+        w->shift1 = value;
+        break;
+    case 5:
+        w->out5 = value;
+        break;
+    }
+}
+
+static void wired_key(WiredPorts *w, uint8_t key, int down)
+{
+    static const uint8_t in1[NUM_KEYS] = {[KEY_COIN] = 0x01, [KEY_P2_START] = 0x02, [KEY_P1_START] = 0x04,
+                                          [KEY_P1_SHOOT] = 0x10, [KEY_P1_LEFT] = 0x20, [KEY_P1_RIGHT] = 0x40};
+    static const uint8_t in2[NUM_KEYS] = {[KEY_TILT] = 0x04, [KEY_P2_SHOOT] = 0x10, [KEY_P2_LEFT] = 0x20,
+                                          [KEY_P2_RIGHT] = 0x40};
+    if (key >= NUM_KEYS)
+    {
+        return;
+    }
+    w->in1 = down ? w->in1 | in1[key] : w->in1 & ~in1[key];
+    w->in2 = down ? w->in2 | in2[key] : w->in2 & ~in2[key];
+}
+
+// drive every game's ports and keys through the tables and through the
+// wired reference with the same random IN, OUT and key events, and time
+// IN and OUT through the tables
+static void bench_ports(int count)
+{
+    SpaceInvadersMachine *machine = machine_create();
+    int same = machine != NULL;
+    unsigned seed = 1;
+    double elapsed = 0;
+    long ops = 0;
+    for (int game = 0; game < NUM_GAMES && same; game++)
+    {
+        machine_reset(machine);
+        port_select(machine, game);
+        machine->in_port = machine->in_port_2 = 0;
+        WiredPorts w = {0};
+        for (int i = 0; i < count && same; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            uint8_t r = seed >> 16, port = (seed >> 24) & 7;
+            if (game != GAME_INVADERS)
+            {
+                // the ports a game doesn't use are reported once per game,
+                // so only Space Invaders tries them
+                port = (r & 3) == 0 ? port & 3 : 2 + port % 5;
+            }
+            switch (r & 3)
+            {
+            case 0:
+                same = input_port(machine, port) == wired_in(&w, port);
+                break;
+            case 1:
+            case 2:
+                output_port(machine, port, r);
+                wired_out(&w, port, r);
+                break;
+            case 3:
+            {
+                // a few past the last key, which no board has
+                uint8_t key = (seed >> 8) % (NUM_KEYS + 2);
+                (r & 4 ? key_down : key_up)(machine, key);
+                wired_key(&w, key, r & 4);
+                break;
+            }
+            }
+        }
+        same = same && machine->out_port_3 == w.out3 && machine->out_port_5 == w.out5 &&
+               machine->in_port == w.in1 && machine->in_port_2 == w.in2;
+
+        // the pattern a frame of the game makes: two shift writes and a read
+        volatile uint8_t sum = 0;
+        double start = now_s();
+        for (int i = 0; i < count; i++)
+        {
+            output_port(machine, 4, i);
+            output_port(machine, 2, i >> 3);
+            sum += input_port(machine, 3) + input_port(machine, 1);
+        }
+        elapsed += now_s() - start;
+        ops += 4L * count;
+    }
+    printf("ports: %.1f ns per IN or OUT through the game tables, %s\n", elapsed / ops * 1e9,
+           check(same, "ports match", "PORTS DIFFER"));
+    machine_destroy(machine);
+}
+
+// the shift register through a call to its own handler
+static uint8_t called_shift_result(SpaceInvadersMachine *machine, uint8_t port)
+{
+    return shift_result(machine);
+}
+
+static void called_shift_data(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
+{
+    shift_data(machine, value);
+}
+
+static void called_shift_offset(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
+{
+    shift_offset(machine, value);
+}
+
+// every port through one call and a switch, as step_cpu went before the
+// port tables
+static uint8_t switched_in(SpaceInvadersMachine *machine, uint8_t port)
+{
+    switch (port)
+    {
+    case 0:
+        return 1;
+    case 1:
+        return machine->in_port;
+    case 2:
+        return machine->in_port_2;
+    case 3:
+        return shift_result(machine);
+    }
+    return 0;
+}
+
+static void switched_out(SpaceInvadersMachine *machine, uint8_t port, uint8_t value)
+{
+    switch (port)
+    {
+    case 2:
+        shift_offset(machine, value);
+        break;
+    case 3:
+        machine->out_port_3 = value;
+        break;
+    case 4:
+        shift_data(machine, value);
+        break;
+    case 5:
+        machine->out_port_5 = value;
+        break;
+    }
+}
+
+// run a loop of the shift register writes and reads the sprite code makes
+// through step_cpu: inline on Space Invaders' table, through handler calls
+// on a copy of it, and through the old switch. the best of a few rounds
+// counts, and all three are checked against the wired reference.
+static void bench_shift(int count)
+{
+    // 2300: INR A; OUT 4; OUT 2; IN 3; JMP 2300
+    static const uint8_t loop[] = {0x3c, 0xd3, 0x04, 0xd3, 0x02, 0xdb, 0x03, 0xc3, 0x00, 0x23};
+    SpaceInvadersMachine *machine = machine_create();
+    if (machine == NULL || mem_init(machine) < 0)
+    {
+        printf("shift: could not load Space Invaders (run from the project root)\n");
+        exit(1);
+    }
+
+    WiredPorts w = {0};
+    uint8_t a = 0;
+    for (int i = 0; i < count; i++)
+    {
+        a++;
+        wired_out(&w, 4, a);
+        wired_out(&w, 2, a);
+        a = wired_in(&w, 3);
+    }
+
+    static PortTable called, switched;
+    called = *machine->ports;
+    called.in[3] = called_shift_result;
+    called.out[2] = called_shift_offset;
+    called.out[4] = called_shift_data;
+    called.shift_result = called.shift_data = called.shift_offset = -1;
+    for (int port = 0; port < 256; port++)
+    {
+        switched.in[port] = switched_in;
+        switched.out[port] = switched_out;
+    }
+    switched.shift_result = switched.shift_data = switched.shift_offset = -1;
+
+    const PortTable *table[3] = {machine->ports, &called, &switched};
+    double best[3] = {1e9, 1e9, 1e9};
+    int same = table[0]->shift_result == 3;
+    for (int round = 0; round < 5; round++)
+    {
+        for (int n = 0; n < 3; n++)
+        {
+            machine_reset(machine);
+            for (int i = 0; i < (int)sizeof(loop); i++)
+            {
+                mem_write(machine, 0x2300 + i, loop[i]);
+            }
+            machine->ports = table[n];
+            machine->state.pc = 0x2300;
+            double start = now_s();
+            for (int i = 0; i < count * 5; i++)
+            {
+                step_cpu(machine);
+            }
+            double elapsed = now_s() - start;
+            best[n] = elapsed < best[n] ? elapsed : best[n];
+            same = same && machine->state.a == a && machine->shift0 == w.shift0 && machine->shift1 == w.shift1 &&
+                   machine->shift_offset == w.offset;
+        }
+    }
+    machine_destroy(machine);
+
+    printf("shift: %d loops of 3 shift register INs and OUTs, %.1f ns per loop inline, %.1f ns through "
+           "handlers, %.1f ns through the old switch, %s\n",
+           count, best[0] / count * 1e9, best[1] / count * 1e9, best[2] / count * 1e9,
+           check(same, "shift matches", "SHIFT DIFFERS"));
+}
+
+// the keys word of bench_input's "input thread", and when the game read
+// its player 1 inputs
+static atomic_uint input_keys;
+static uint64_t *input_reads;
+static unsigned int input_held;
+static int input_count, input_max, input_seen;
+
+// the real player 1 handler, with every read logged. just before each one
+// the other thread flips the left key, and the game has to see the flip.
+static uint8_t traced_player1(SpaceInvadersMachine *machine, uint8_t port)
+{
+    int left = input_count & 1;
+    if (input_count < input_max)
+    {
+        input_reads[input_count++] = machine_cycles(machine);
+    }
+    atomic_store(&input_keys, input_held | (left ? 1u << KEY_P1_LEFT : 0));
+    uint8_t value = port_table(GAME_INVADERS)->in[port](machine, port);
+    input_seen += !!(value & games[GAME_INVADERS].key[KEY_P1_LEFT].mask) == left;
+    return value;
+}
+
+// play frames of Space Invaders, a game started with a coin and player 1
+// start, with the keys sampled as the game reads IN 1, and work out how
+// long after a key press the game sees it: at its next read, or at its
+// first read after the next interrupt, when the emulation thread passed
+// the keys on before each half frame
+static void bench_input(int frames)
+{
+    SpaceInvadersMachine *machine = machine_create();
+    if (machine == NULL || mem_init(machine) < 0)
+    {
+        printf("input: could not load Space Invaders (run from the project root)\n");
+        exit(1);
+    }
+    input_max = frames * 64;
+    input_reads = malloc(input_max * sizeof(uint64_t));
+    uint64_t *interrupts = malloc(2 * frames * sizeof(uint64_t));
+
+    // the machine runs a copy of its table with the traced handler
+    static PortTable traced;
+    traced = *machine->ports;
+    traced.in[1] = traced_player1;
+    machine->ports = &traced;
+    machine->keys = &input_keys;
+    for (int i = 0; i < 2 * frames; i++)
+    {
+        input_held = i >= 20 && i < 30 ? 1u << KEY_COIN : i >= 120 && i < 130 ? 1u << KEY_P1_START : 0;
+        run_to_interrupt(machine);
+        interrupts[i] = machine_cycles(machine);
+    }
+
+    // a press every 1000 cycles, from when the game has started to the last
+    // read
+    double jit_sum = 0, frame_sum = 0;
+    uint64_t jit_max = 0, frame_max = 0;
+    int presses = 0;
+    int next_read = 0, next_interrupt = 0;
+    for (uint64_t at = interrupts[400]; input_count > 0 && at < input_reads[input_count - 1]; at += 1000)
+    {
+        while (input_reads[next_read] < at)
+        {
+            next_read++;
+        }
+        while (next_interrupt < 2 * frames && interrupts[next_interrupt] < at)
+        {
+            next_interrupt++;
+        }
+        if (next_interrupt == 2 * frames)
+        {
+            break;
+        }
+        int read = next_read;
+        while (read < input_count && input_reads[read] < interrupts[next_interrupt])
+        {
+            read++;
+        }
+        if (read == input_count)
+        {
+            break;
+        }
+        uint64_t jit = input_reads[next_read] - at;
+        uint64_t frame = input_reads[read] - at;
+        jit_sum += jit;
+        frame_sum += frame;
+        jit_max = jit > jit_max ? jit : jit_max;
+        frame_max = frame > frame_max ? frame : frame_max;
+        presses++;
+    }
+    double ms = 1000.0 / CPU_CLOCK;
+    printf("input: %d reads of IN 1 in %d frames, a key is seen %.2f ms (at most %.2f) after it is pressed, "
+           "%.2f ms (at most %.2f) if passed on at interrupts, %s\n",
+           input_count, frames, jit_sum / presses * ms, jit_max * ms, frame_sum / presses * ms, frame_max * ms,
+           check(input_count > 0 && input_seen == input_count, "keys match", "KEYS DIFFER"));
+    machine_destroy(machine);
+    free(input_reads);
+    free(interrupts);
+}
+
+// the first interrupt at which video memory of the machine in snapshot
+// differs with and without key pressed (or released, with down 0)
+static uint64_t first_change(const MachineSnapshot *snapshot, uint8_t key, int down)
+{
+    SpaceInvadersMachine *with = machine_create();
+    SpaceInvadersMachine *without = machine_create();
+    machine_restore(with, snapshot);
+    machine_restore(without, snapshot);
+    (down ? key_down : key_up)(with, key);
+    uint64_t at = 0;
+    for (int i = 0; i < LATENCY_MAX_INTERRUPTS && at == 0; i++)
+    {
+        run_to_interrupt(with);
+        run_to_interrupt(without);
+        if (memcmp(with->memory + VRAM_START, without->memory + VRAM_START, RAM_END - VRAM_START) != 0)
+        {
+            at = machine_cycles(with);
+        }
+    }
+    machine_destroy(with);
+    machine_destroy(without);
+    return at;
+}
+
+// follow presses of player 1's right key through a game the way --latency
+// does, with the event loop and the drawing played by this thread, and
+// check that each screen change is found at the interrupt where a machine
+// pressed and one not pressed first draw something different
+static void bench_latency(int frames)
+{
+    SpaceInvadersMachine *machine = machine_create();
+    if (machine == NULL || mem_init(machine) < 0)
+    {
+        printf("latency: could not load Space Invaders (run from the project root)\n");
+        exit(1);
+    }
+    atomic_uint keys = 0;
+    machine->keys = &keys;
+    Latency latency;
+    if (latency_init(&latency, machine) < 0)
+    {
+        printf("latency: could not set up\n");
+        exit(1);
+    }
+
+    MachineSnapshot *pressed = NULL;
+    int down = 0, checked = 0, same = 1;
+    double emulated = 0;
+    for (int i = 0; i < 2 * frames; i++)
+    {
+        // start a game, then press or release right every 37 interrupts
+        unsigned int held = i >= 20 && i < 30 ? 1u << KEY_COIN : i >= 120 && i < 130 ? 1u << KEY_P1_START : 0;
+        if (i >= 400 && i % 37 == 0)
+        {
+            down = !down;
+            if (atomic_load(&latency.state) == LATENCY_IDLE)
+            {
+                if (pressed != NULL)
+                {
+                    snapshot_destroy(pressed);
+                }
+                pressed = machine_snapshot(machine);
+            }
+            latency_key(&latency, KEY_P1_RIGHT, down);
+        }
+        atomic_store(&keys, held | (down ? 1u << KEY_P1_RIGHT : 0));
+
+        run_to_interrupt(machine);
+        latency_interrupt(&latency);
+        if (atomic_load(&latency.state) == LATENCY_VRAM && pressed != NULL)
+        {
+            same = same && latency.vram_cycles == first_change(pressed, latency.key, latency.down);
+            emulated += latency.vram_cycles - latency.read_cycles;
+            checked++;
+            snapshot_destroy(pressed);
+            pressed = NULL;
+        }
+        latency_present(&latency, machine_cycles(machine));
+    }
+    if (pressed != NULL)
+    {
+        snapshot_destroy(pressed);
+    }
+
+    printf("latency: %d presses followed (%d unseen), screen changed %.2f ms of emulated time after the read, %s\n",
+           latency.count, latency.unseen, checked ? emulated / checked * 1000 / CPU_CLOCK : 0,
+           check(checked > 0 && checked == latency.count && same, "latency matches", "LATENCY DIFFERS"));
+    latency_free(&latency);
+    machine_destroy(machine);
+}
+
+// a sound card whose clock is off by drift (0.003 is 0.3% fast) against
+// the emulation, in simulated time. paced by the mixer, how far emulated
+// time leads the output must settle and stay near MIX_LATENCY for the whole
+// run. paced by the host clock it wanders off until the output resyncs.
+static void run_audio_clock(double drift, int frames, int paced, int64_t *low, int64_t *high, int *resyncs)
+{
+    Mixer *mixer = mixer_create();
+    int16_t buffer[256];
+    double card_ns = 256 * 1e9 / (MIX_RATE * (1 + drift));
+    double card = 0, frame_at = 0;
+    int64_t last = INT64_MIN;
+    *low = INT64_MAX;
+    *high = INT64_MIN;
+    *resyncs = 0;
+    for (int frame = 1; frame <= frames;)
+    {
+        if (card <= frame_at)
+        {
+            mixer_render(mixer, buffer, 256);
+            card += card_ns;
+            continue;
+        }
+        uint64_t at = (uint64_t)frame * FRAME_CYCLES * MIX_RATE / CPU_CLOCK;
+        mixer_mark(mixer, at);
+        frame_at += paced ? mixer_pace(mixer, at, FRAME_NS) : FRAME_NS;
+        int64_t played = mixer_played(mixer);
+        if (played >= 0)
+        {
+            int64_t lead = (int64_t)at - played;
+            // a frame and a buffer is as far as it moves in one step
+            *resyncs += last != INT64_MIN && (lead - last > 1000 || last - lead > 1000);
+            last = lead;
+            if (frame > 600)
+            {
+                *low = lead < *low ? lead : *low;
+                *high = lead > *high ? lead : *high;
+            }
+        }
+        frame++;
+    }
+    mixer_destroy(mixer);
+}
+
+static void bench_audio_pace(double drift, int frames)
+{
+    int64_t low, high, clock_low, clock_high;
+    int resyncs, clock_resyncs;
+    run_audio_clock(drift, frames, 1, &low, &high, &resyncs);
+    run_audio_clock(drift, frames, 0, &clock_low, &clock_high, &clock_resyncs);
+    int holds = resyncs == 0 && low >= 0 && high <= 2 * MIX_LATENCY;
+    printf("audio pace: card %+.1f%%, %d frames, lead %lld..%lld samples (host clock: %lld..%lld, %d resyncs), %s\n",
+           drift * 100, frames, (long long)low, (long long)high, (long long)clock_low, (long long)clock_high,
+           clock_resyncs, check(holds, "latency holds", "LATENCY DRIFTS"));
+}
+
+// play a game with its sound (samples, or synthesized with synth set) into a
+// wav file, mixing block samples at a time as emulated time passes. returns
+// the seconds it took.
+static double render_audio(const char *path, int frames, int block, int synth)
+{
+    SpaceInvadersMachine *machine;
+    load_lanes(&machine, 1);
+    Mixer *mixer = audio_create(GAME_INVADERS, synth);
+    FILE *wav = wav_open(path);
+    if (mixer == NULL || wav == NULL)
+    {
+        printf("audio: could not load the sounds or write %s\n", path);
+        exit(1);
+    }
+    mixer_sync(mixer, 0);
+    machine->sound.mixer = mixer;
+    machine->sound.synth = synth;
+
+    int16_t *out = malloc(block * sizeof(int16_t));
+    uint64_t rendered = 0;
+    double start = now_s();
+    for (int f = 0; f < frames; f++)
+    {
+        lane_input(machine, 0, f, 1);
+        run_frame(machine);
+        uint64_t now = machine_cycles(machine) * MIX_RATE / CPU_CLOCK;
+        while (rendered < now)
+        {
+            int count = now - rendered < (uint64_t)block ? now - rendered : block;
+            mixer_render(mixer, out, count);
+            wav_write(wav, out, count);
+            rendered += count;
+        }
+    }
+    wav_close(wav);
+    double elapsed = now_s() - start;
+
+    free(out);
+    machine->sound.mixer = NULL;
+    mixer_destroy(mixer);
+    machine_destroy(machine);
+    return elapsed;
+}
+
+// render the same game to wav twice, in blocks of different sizes. the two
+// files must be the same byte for byte and have the sounds in them.
+static void bench_audio(int frames, int synth)
+{
+    char first[] = "/tmp/bench-audioXXXXXX";
+    char second[] = "/tmp/bench-audioXXXXXX";
+    int fd1 = mkstemp(first);
+    int fd2 = mkstemp(second);
+    if (fd1 < 0 || fd2 < 0)
+    {
+        printf("audio: could not make a file in /tmp\n");
+        exit(1);
+    }
+    close(fd1);
+    close(fd2);
+
+    double elapsed = render_audio(first, frames, 735, synth);
+    render_audio(second, frames, 64, synth);
+
+    FILE *a = fopen(first, "rb");
+    FILE *b = fopen(second, "rb");
+    long size = 0, loud = 0;
+    int same = a != NULL && b != NULL;
+    for (int x = 0; same && (x = fgetc(a)) != EOF; size++)
+    {
+        same &= x == fgetc(b);
+        loud += size >= 44 && x != 0;
+    }
+    same &= b != NULL && fgetc(b) == EOF && loud > 0;
+    if (a != NULL)
+        fclose(a);
+    if (b != NULL)
+        fclose(b);
+    remove(first);
+    remove(second);
+
+    double seconds = (size - 44) / 2.0 / MIX_RATE;
+    printf("audio %s: %.1f s of sound in %.0f ms, %.0fx real time, %s\n", synth ? "synth" : "samples", seconds,
+           elapsed * 1e3, seconds / elapsed, check(same, "audio matches", "AUDIO DIFFERS"));
+}
+
+static FrameBuffer frames;
+static atomic_int frames_done;
+
+// writer for bench_frames: change a few random columns per frame, filling
+// them with the frame number, and publish
+static void *publish_frames(void *arg)
+{
+    int count = *(int *)arg;
+    uint8_t vram[VRAM_SIZE] = {0};
+    uint8_t columns[SCREEN_WIDTH] = {0};
+    unsigned int seed = 1;
+    for (int f = 1; f <= count; f++)
+    {
+        // capture the top at "RST 1" and the rest at "RST 2", changing
+        // columns before each
+        for (int i = 0; i < 8; i++)
+        {
+            int x = rand_r(&seed) % SCREEN_WIDTH;
+            memset(vram + x * 32, f, 32);
+            columns[x] = 1;
+            if (i == 3)
+            {
+                frames_capture(&frames, vram, columns, 0, MID_SCREEN_LINE);
+            }
+        }
+        frames_capture(&frames, vram, columns, MID_SCREEN_LINE, SCREEN_WIDTH - MID_SCREEN_LINE);
+        frames_publish(&frames);
+        // let the reader in now and then, even on one core, so that some
+        // frames are taken and some skipped
+        if (rand_r(&seed) % 4 == 0)
+        {
+            sched_yield();
+        }
+    }
+    frames_done = 1;
+    return NULL;
+}
+
+// hand frames between two threads and rebuild the screen on the reader side
+// from the changed columns only. it must always equal the frame's memory,
+// however many frames the reader skips.
+static void bench_frames(int count)
+{
+    frames_init(&frames);
+    frames_done = 0;
+    pthread_t writer;
+    double start = now_s();
+    pthread_create(&writer, NULL, publish_frames, &count);
+
+    static uint8_t screen[VRAM_SIZE];
+    int taken = 0, same = 1;
+    for (;;)
+    {
+        int done = frames_done;
+        Frame *frame = frames_take(&frames);
+        if (frame == NULL)
+        {
+            if (done)
+            {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        for (int x = 0; x < SCREEN_WIDTH; x++)
+        {
+            if (frame->columns[x])
+            {
+                memcpy(screen + x * 32, frame->vram + x * 32, 32);
+            }
+        }
+        same &= memcmp(screen, frame->vram, VRAM_SIZE) == 0;
+        taken++;
+    }
+    pthread_join(writer, NULL);
+    double elapsed = now_s() - start;
+
+    printf("frames: %d published, %d taken, %.0f ns per frame, %s\n", count, taken, elapsed / count * 1e9,
+           check(same, "screens match", "SCREENS DIFFER"));
+}
+
+int main(int argc, char **argv)
+{
+    bench_env(ENV_OBS_VRAM, 1, 20000);
+    bench_env(ENV_OBS_GRAY, 1, 20000);
+    bench_env(ENV_OBS_GRAY, 4, 5000);
+    bench_batch(8, 1000, 0);
+    bench_batch(16, 1000, 0);
+    bench_batch(16, 1000, 1);
+    bench_snapshot(20000);
+    bench_hash(1000000);
+    bench_video(2000, 1);
+    bench_video(1000, 2);
+    bench_video(500, 3);
+    bench_dirty(3000, 1);
+    bench_dirty(3000, 3);
+    bench_run_cpu(600);
+    bench_pacing(120);
+    bench_ports(1000000);
+    bench_shift(2000000);
+    bench_input(1200);
+    bench_latency(1200);
+    bench_shots(1200, 1, SHOT_PPM);
+    bench_shots(1200, 10, SHOT_PPM);
+    bench_shots(1200, 1, SHOT_PNG);
+    bench_shots(1200, 10, SHOT_PNG);
+    bench_y4m(600);
+    bench_mixer(20000, 256);
+    bench_audio_pace(0.003, 216000);
+    bench_audio_pace(-0.003, 216000);
+    bench_synth(20000, 256);
+    bench_bank(50);
+    bench_audio(1800, 0);
+    bench_audio(1800, 1);
+    bench_frames(200000);
+
+    if (failed_checks > 0)
+    {
+        printf("%d checks failed\n", failed_checks);
+        return 1;
+    }
+    return 0;
+}
@@ -12,13 +12,19 @@
 #include <stdlib.h>
 
 #include "disasm.h"
+#include "machine.h"
 #include "memory.h"
 #include "processor.h"
 
 int main(int argc, char **argv)
 {
-    // initialize memory buffer and load file into memory
-    load_file("cpudiag.bin", 0x100);
+    // create a machine and load the test program into its memory
+    SpaceInvadersMachine *machine = machine_create();
+    if (machine == NULL || load_file(machine, "cpudiag.bin", 0x100) < 0)
+    {
+        return 1;
+    }
+    unsigned char *memory = machine->memory;
 
     // some other initialization steps
     // we need the first thing to happen be jumping to the code at 0x100
@@ -39,12 +45,11 @@ int main(int argc, char **argv)
     // may also have to modify something in the cpu emulation for instruction 0xcd (CALL)
     // which prints things to the console.
 
-    // set up a State8080 struct
-    State8080 cpu_state;
-    //  try setting the initial pc value - should point to the start of the program
-    cpu_state.pc = 0;
-    cpu_state.memory = memory;
-    while (cpu_state.pc < sizeof(memory))
+    // the machine's CPU state starts with pc = 0, which
+    // should point to the start of the program
+    State8080 *cpu_state = &machine->state;
+    // stop if the program runs off the end of the 20K game area
+    while (cpu_state->pc < 0x4FFF)
     {
         // pc += disassemble_i8080(buffer, pc);
         // cpu_state.pc += disassemble_i8080(buffer, cpu_state.pc);
@@ -53,11 +58,12 @@ int main(int argc, char **argv)
         // printf("pc: %d\n", cpu_state.pc);
         // printf("instruction: %02X\n", cpu_state.memory[cpu_state.pc]);
 
-         emulate_i8080(&cpu_state);
+         emulate_i8080(cpu_state);
 
         // wait for user to press enter before going to next instruction
         // getchar();
     }
 
+    machine_destroy(machine);
     return 0;
 }
\ No newline at end of file